@@ -40,10 +40,34 @@
 #define CMT_PROP_ORIENTATION_MINIMUM "Orientation Minimum"
 #define CMT_PROP_ORIENTATION_MAXIMUM "Orientation Maximum"
 
+/* 32 bit */
+#define CMT_PROP_RAW_TOUCH_DEADBAND "Raw Touch Deadband"
+
+/* 32 bit */
+#define CMT_PROP_READ_FRAME_BUDGET "Read Frame Budget"
+#define CMT_PROP_READ_TIME_BUDGET  "Read Time Budget"
+
+/* 32 bit, read-only */
+#define CMT_PROP_RAW_TOUCH_SUPPRESSED "Raw Touch Suppressed Updates"
+#define CMT_PROP_GESTURES_COALESCED "Gestures Coalesced"
+#define CMT_PROP_MOUSE_FRAMES_BATCHED "Mouse Frames Batched"
+#define CMT_PROP_READ_STATS "Read Statistics"
+#define CMT_PROP_TIMER_LATENESS "Timer Lateness"
+#define CMT_PROP_PUSHES_SKIPPED "Property Pushes Skipped"
+#define CMT_PROP_DUMP_DEBUG_LOG_STATUS "Dump Debug Log Status"
+#define CMT_PROP_PERF_COUNTERS "Performance Counters"
+
+/* 32 bit, read-only, writing any value resets it */
+#define CMT_PROP_INPUT_LATENCY "Input Latency"
+
 /* Bool */
 #define CMT_PROP_SCROLL_BTN  "Scroll Buttons"
 #define CMT_PROP_SCROLL_AXES "Scroll Axes"
 #define CMT_PROP_DUMP_DEBUG_LOG "Dump Debug Log"
+#define CMT_PROP_DUMP_DEBUG_LOG_ASYNC "Dump Debug Log Async"
 #define CMT_PROP_RAW_TOUCH_PASSTHROUGH "Raw Touch Passthrough"
+#define CMT_PROP_RAW_TOUCH_SKIP_UNCHANGED "Raw Touch Skip Unchanged"
+#define CMT_PROP_COALESCE_GESTURES "Coalesce Gestures"
+#define CMT_PROP_MOUSE_BATCH_FRAMES "Mouse Batch Frames"
 
 #endif
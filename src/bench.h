@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include "cmt.h"
+#include "cmt-properties.h"
+
+/*
+ * Minimal benchmark harness for the driver hot paths. Benchmarks run the
+ * real driver code against the X entry points stubbed in test_stubs.c.
+ */
+
+typedef void (*BenchFunc)(void* data, unsigned long iterations);
+
+typedef struct {
+    InputInfoRec info;
+    DeviceIntRec dev;
+    CmtDeviceRec cmt;
+} BenchDeviceRec, *BenchDevicePtr;
+
+/*
+ * Run fn with increasing iteration counts until it has run long enough to
+ * be measured, then print the cost and heap allocations per iteration.
+ */
+void Bench_Run(const char* name, BenchFunc fn, void* data);
+
+/*
+ * Create a device of the given class with slot_count MT slots, all free,
+ * with properties and the gestures interpreter initialized and turned on.
+ */
+BenchDevicePtr Bench_Device_New(EvdevClass cls, int slot_count);
+void Bench_Device_Free(BenchDevicePtr);
+
+/* Property handlers captured by the XIRegisterPropertyHandler stub */
+extern int (*stub_property_set)(DeviceIntPtr, Atom, XIPropertyValuePtr, BOOL);
+extern int (*stub_property_get)(DeviceIntPtr, Atom);
+
+/* Benchmark groups */
+void Gesture_Bench(void);
+void Properties_Bench(void);
+void Timer_Bench(void);
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Minimum wall time a measurement must cover to be reported */
+#define BENCH_MIN_NS 200000000ULL
+
+/*
+ * Count heap allocations, including the ones made inside libgestures, by
+ * wrapping the glibc allocator.
+ */
+extern void* __libc_malloc(size_t);
+extern void* __libc_calloc(size_t, size_t);
+extern void* __libc_realloc(void*, size_t);
+
+static unsigned long bench_allocs;
+
+void*
+malloc(size_t size)
+{
+    bench_allocs++;
+    return __libc_malloc(size);
+}
+
+void*
+calloc(size_t nmemb, size_t size)
+{
+    bench_allocs++;
+    return __libc_calloc(nmemb, size);
+}
+
+void*
+realloc(void* ptr, size_t size)
+{
+    bench_allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+static unsigned long long
+Bench_Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+Bench_Run(const char* name, BenchFunc fn, void* data)
+{
+    unsigned long iterations = 1;
+    unsigned long long start;
+    unsigned long long elapsed;
+    unsigned long allocs;
+
+    for (;;) {
+        allocs = bench_allocs;
+        start = Bench_Now();
+        fn(data, iterations);
+        elapsed = Bench_Now() - start;
+        allocs = bench_allocs - allocs;
+        if (elapsed >= BENCH_MIN_NS || iterations >= (1UL << 30))
+            break;
+        iterations *= 2;
+    }
+
+    printf("%-56s %12lu %10.1f ns/op %8.2f allocs/op\n", name, iterations,
+           (double)elapsed / iterations, (double)allocs / iterations);
+}
+
+BenchDevicePtr
+Bench_Device_New(EvdevClass cls, int slot_count)
+{
+    BenchDevicePtr bd;
+    CmtDevicePtr cmt;
+    int i;
+
+    bd = calloc(1, sizeof(*bd));
+    if (!bd)
+        return NULL;
+    cmt = &bd->cmt;
+
+    bd->info.private = cmt;
+    bd->info.fd = -1;
+    bd->dev.public.devicePrivate = &bd->info;
+
+    /* Published as the Device Node property */
+    cmt->device = (char*)"/dev/input/event-bench";
+    cmt->evdev.fd = -1;
+    cmt->evdev.evstate = &cmt->evstate;
+    cmt->evdev.info.evdev_class = cls;
+    cmt->evstate.slot_count = slot_count;
+    cmt->evstate.slots = calloc(slot_count, sizeof(*cmt->evstate.slots));
+    for (i = 0; i < slot_count; i++)
+        cmt->evstate.slots[i].tracking_id = -1;
+
+    if (Gesture_Init(&cmt->gesture) != Success)
+        abort();
+    if (PropertiesInit(&bd->dev) != Success)
+        abort();
+    Gesture_Device_Init(&cmt->gesture, &bd->dev);
+    PropertiesPublish(&bd->dev);
+    Gesture_Device_On(&cmt->gesture);
+    return bd;
+}
+
+void
+Bench_Device_Free(BenchDevicePtr bd)
+{
+    Gesture_Device_Off(&bd->cmt.gesture);
+    Gesture_Device_Close(&bd->cmt.gesture);
+    PropertiesClose(&bd->dev);
+    Gesture_Free(&bd->cmt.gesture);
+    free(bd->cmt.evstate.slots);
+    free(bd);
+}
+
+int
+main(int argc, char** argv)
+{
+    Gesture_Bench();
+    Properties_Bench();
+    Timer_Bench();
+    return 0;
+}
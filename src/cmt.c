@@ -12,6 +12,8 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <exevents.h>
@@ -44,6 +46,9 @@
 
 #define AXIS_LABEL_PROP_ABS_FINGER_COUNT   "Abs Finger Count"
 
+#define AXIS_LABEL_PROP_ABS_DBL_PINCH_DZ         "Abs Dbl Pinch Scale"
+#define AXIS_LABEL_PROP_ABS_DBL_PINCH_ORDINAL_DZ "Abs Dbl Ordinal Pinch Scale"
+
 #define AXIS_LABEL_PROP_ABS_TOUCH_TIMESTAMP "Touch Timestamp"
 
 /**
@@ -57,6 +62,8 @@ static void Unplug(pointer);
 
 static int DeviceControl(DeviceIntPtr, int);
 static void ReadInput(InputInfoPtr);
+static void CountSynDropped(CmtDevicePtr);
+static void SynReport(void*, EventStatePtr, struct timeval*);
 
 static Bool DeviceInit(DeviceIntPtr);
 static Bool DeviceOn(DeviceIntPtr);
@@ -64,6 +71,7 @@ static Bool DeviceOff(DeviceIntPtr);
 static Bool DeviceClose(DeviceIntPtr);
 
 static Bool OpenDevice(InputInfoPtr);
+static Bool SameDevice(InputInfoPtr);
 static int InitializeXDevice(DeviceIntPtr dev);
 
 static void libevdev_log_x(void* udata, int level, const char* format, ...)
@@ -78,6 +86,8 @@ static void libevdev_log_x(void* udata, int level, const char* format, ...) {
   int type;
 
   va_list args;
+  if (level == LOGLEVEL_DEBUG && !CMT_LOG_ENABLED(DBG_VERB))
+    return;
   va_start(args, format);
   if (level == LOGLEVEL_DEBUG) {
     type = X_INFO;
@@ -110,6 +120,9 @@ static int
 PreInit(InputDriverPtr drv, InputInfoPtr info, int flags)
 {
     CmtDevicePtr cmt;
+    CARD64 start = GetTimeInMicros();
+    CARD64 opened;
+    CARD64 probed;
     int rc;
 
     DBG(info, "NewPreInit\n");
@@ -129,12 +142,13 @@ PreInit(InputDriverPtr drv, InputInfoPtr info, int flags)
     cmt->evdev.log_udata = info;
     cmt->evdev.fd = info->fd;
     cmt->evdev.evstate = &cmt->evstate;
-    cmt->evdev.syn_report = &Gesture_Process_Slots;
-    cmt->evdev.syn_report_udata = &cmt->gesture;
+    cmt->evdev.syn_report = &SynReport;
+    cmt->evdev.syn_report_udata = cmt;
 
     rc = OpenDevice(info);
     if (rc != Success)
         goto Error_OpenDevice;
+    opened = GetTimeInMicros();
 
     rc = Event_Init(&cmt->evdev);
     if (rc != Success) {
@@ -143,6 +157,7 @@ PreInit(InputDriverPtr drv, InputInfoPtr info, int flags)
         }
         goto Error_Event_Init;
     }
+    probed = GetTimeInMicros();
 
     // The cmt driver currently powers mice, multi-touch mice and touchpads.
     // We list mice as XI_MOUSE and the others as XI_TOUCHPAD.
@@ -153,13 +168,18 @@ PreInit(InputDriverPtr drv, InputInfoPtr info, int flags)
 
     xf86ProcessCommonOptions(info, info->options);
 
-    if (info->fd >= 0)
-        info->fd = EvdevClose(&cmt->evdev);
-
-    rc = Gesture_Init(&cmt->gesture, Event_Get_Slot_Count(&cmt->evdev));
+    /*
+     * The fd stays open for the first DeviceOn, which follows right away
+     * on hotplug, so the device is not opened twice.
+     */
+    rc = Gesture_Init(&cmt->gesture);
     if (rc != Success)
         goto Error_Gesture_Init;
 
+    DBG(info, "Pre-initialized in %llu us (open %llu us, probe %llu us)\n",
+        (unsigned long long)(GetTimeInMicros() - start),
+        (unsigned long long)(opened - start),
+        (unsigned long long)(probed - opened));
     return Success;
 
 Error_Gesture_Init:
@@ -185,6 +205,9 @@ UnInit(InputDriverPtr drv, InputInfoPtr info, int flags)
     DBG(info, "UnInit\n");
 
     if (cmt) {
+        /* Still open from PreInit if the device was never turned on */
+        if (info->fd >= 0)
+            info->fd = EvdevClose(&cmt->evdev);
         Gesture_Free(&cmt->gesture);
         free(cmt->device);
         cmt->device = NULL;
@@ -218,13 +241,49 @@ DeviceControl(DeviceIntPtr dev, int mode)
     return BadValue;
 }
 
+/*
+ * Drain the device in bulk, so each wakeup handles every complete frame that
+ * is already queued. The frame and time budgets keep a flood of events from
+ * one device from starving the others; whatever is left over is read on the
+ * next wakeup.
+ */
 static void
 ReadInput(InputInfoPtr info)
 {
     CmtDevicePtr cmt = info->private;
+    CmtPropertiesPtr props = &cmt->props;
+    int* stats = cmt->read_stats;
+    int start_frames = stats[CMT_READ_STAT_FRAMES];
+    CARD64 deadline = GetTimeInMicros() + props->read_time_budget;
+    int frames;
+    int err;
+
+    stats[CMT_READ_STAT_WAKEUPS]++;
+    for (;;) {
+        err = EvdevRead(&cmt->evdev);
+        CountSynDropped(cmt);
+        if (err != Success)
+            break;
+        stats[CMT_READ_STAT_READS]++;
+
+        frames = stats[CMT_READ_STAT_FRAMES] - start_frames;
+        if ((props->read_frame_budget > 0 &&
+             frames >= props->read_frame_budget) ||
+            (props->read_time_budget > 0 && GetTimeInMicros() >= deadline)) {
+            stats[CMT_READ_STAT_BUDGET_EXHAUSTED]++;
+            break;
+        }
+    }
+
+    Gesture_Flush_Batch(&cmt->gesture);
+
+    frames = stats[CMT_READ_STAT_FRAMES] - start_frames;
+    if (frames > stats[CMT_READ_STAT_MAX_FRAMES])
+        stats[CMT_READ_STAT_MAX_FRAMES] = frames;
 
-    int err = EvdevRead(&cmt->evdev);
     if (err != Success) {
+      if (err != EAGAIN)
+          cmt->perf_counters[CMT_PERF_READ_ERRORS]++;
       if (err == ENODEV) {
           xf86RemoveEnabledDevice(info);
           info->fd = EvdevClose(&cmt->evdev);
@@ -234,6 +293,38 @@ ReadInput(InputInfoPtr info)
     }
 }
 
+/*
+ * Count the SYN_DROPPED events read since the last call. libevdev resyncs
+ * its state on a drop without telling the driver, but every event it reads
+ * also goes into its debug buffer, which is scanned here.
+ */
+static void
+CountSynDropped(CmtDevicePtr cmt)
+{
+    EvdevPtr evdev = &cmt->evdev;
+    size_t i;
+
+    for (i = cmt->debug_buf_seen; i != evdev->debug_buf_tail;
+         i = (i + 1) % DEBUG_BUF_SIZE)
+        if (evdev->debug_buf[i].type == EV_SYN &&
+            evdev->debug_buf[i].code == SYN_DROPPED)
+            cmt->perf_counters[CMT_PERF_SYN_DROPPED]++;
+    cmt->debug_buf_seen = evdev->debug_buf_tail;
+}
+
+/*
+ * Called by libevdev for every SYN_REPORT it reads.
+ */
+static void
+SynReport(void* udata, EventStatePtr evstate, struct timeval* tv)
+{
+    CmtDevicePtr cmt = udata;
+
+    cmt->read_stats[CMT_READ_STAT_FRAMES]++;
+    Recorder_Frame(&cmt->recorder, &cmt->evdev, tv);
+    Gesture_Process_Slots(&cmt->gesture, evstate, tv);
+}
+
 /**
  * device control event handlers
  */
@@ -242,6 +333,8 @@ DeviceInit(DeviceIntPtr dev)
 {
     InputInfoPtr info = dev->public.devicePrivate;
     CmtDevicePtr cmt = info->private;
+    CARD64 start = GetTimeInMicros();
+    Bool deferred;
     int rc;
 
     DBG(info, "DeviceInit\n");
@@ -252,9 +345,18 @@ DeviceInit(DeviceIntPtr dev)
     rc = PropertiesInit(dev);
     if (rc != Success)
         return rc;
+    deferred = cmt->props_deferred;
 
     Gesture_Device_Init(&cmt->gesture, dev);
 
+    PropertiesPublish(dev);
+
+    Recorder_Open(&cmt->recorder, info, &cmt->evdev);
+
+    DBG(info, "Initialized in %llu us (%s properties)\n",
+        (unsigned long long)(GetTimeInMicros() - start),
+        deferred ? "deferred" : "immediate");
+
     return Success;
 }
 
@@ -263,18 +365,50 @@ DeviceOn(DeviceIntPtr dev)
 {
     InputInfoPtr info = dev->public.devicePrivate;
     CmtDevicePtr cmt = info->private;
+    CARD64 start = GetTimeInMicros();
+    CARD64 opened;
+    Bool reopened = info->fd < 0;
     int rc;
 
     DBG(info, "DeviceOn\n");
 
+    /* The node may have been replaced since PreInit, leaving the fd stale */
+    if (!reopened && !SameDevice(info)) {
+        info->fd = EvdevClose(&cmt->evdev);
+        reopened = TRUE;
+    }
+
     rc = OpenDevice(info);
     if (rc != Success)
         return rc;
+
+    /*
+     * Capabilities were probed in PreInit and only hold for the same
+     * device. The fd kept open since PreInit has queued stale events.
+     */
+    if (reopened) {
+        if (!SameDevice(info)) {
+            ERR(info, "\"%s\" is no longer the device probed at PreInit\n",
+                cmt->device);
+            info->fd = EvdevClose(&cmt->evdev);
+            return BadMatch;
+        }
+    } else {
+        xf86FlushInput(info->fd);
+    }
+    opened = GetTimeInMicros();
+
     Event_Open(&cmt->evdev);
 
     xf86AddEnabledDevice(info);
     dev->public.on = TRUE;
     Gesture_Device_On(&cmt->gesture);
+
+    DBG(info, "Turned on in %llu us (%s %llu us, sync %llu us)\n",
+        (unsigned long long)(GetTimeInMicros() - start),
+        reopened ? "reopen" : "flush",
+        (unsigned long long)(opened - start),
+        (unsigned long long)(GetTimeInMicros() - opened));
     return Success;
 }
 
@@ -304,6 +438,8 @@ DeviceClose(DeviceIntPtr dev)
     DBG(info, "DeviceClose\n");
 
     DeviceOff(dev);
+    DebugLog_Close(info);
+    Recorder_Close(&cmt->recorder);
     Gesture_Device_Close(&cmt->gesture);
     PropertiesClose(dev);
     return Success;
@@ -340,6 +476,27 @@ OpenDevice(InputInfoPtr info)
     return Success;
 }
 
+/*
+ * Cheap identity check of an open device node against the probe results:
+ * the node still names the device behind the fd, with the same input id.
+ */
+static Bool
+SameDevice(InputInfoPtr info)
+{
+    CmtDevicePtr cmt = info->private;
+    struct input_id id;
+    struct stat fd_stat;
+    struct stat node_stat;
+
+    if (fstat(info->fd, &fd_stat) < 0 || stat(cmt->device, &node_stat) < 0)
+        return FALSE;
+    if (fd_stat.st_rdev != node_stat.st_rdev)
+        return FALSE;
+    if (ioctl(info->fd, EVIOCGID, &id) < 0)
+        return FALSE;
+    return !memcmp(&id, &cmt->evdev.info.id, sizeof(id));
+}
+
 
 /**
  * Setup X Input Device Classes
@@ -392,6 +549,8 @@ InitializeXDevice(DeviceIntPtr dev)
         AXIS_LABEL_PROP_ABS_MT_PRESSURE,
         AXIS_LABEL_PROP_ABS_MT_TOUCH_MAJOR,
         AXIS_LABEL_PROP_ABS_TOUCH_TIMESTAMP,
+        AXIS_LABEL_PROP_ABS_DBL_PINCH_DZ,
+        AXIS_LABEL_PROP_ABS_DBL_PINCH_ORDINAL_DZ,
     };
     static const char* btn_names[CMT_NUM_BUTTONS] = {
         BTN_LABEL_PROP_BTN_LEFT,
@@ -434,8 +593,9 @@ InitializeXDevice(DeviceIntPtr dev)
 
     for (i = 0; i < CMT_NUM_AXES; i++) {
         int mode = (i == CMT_AXIS_X || i == CMT_AXIS_Y) ? Relative : Absolute;
-        if (i >= CMT_AXIS_MT_POSITION_X)
-            break;
+        /* Raw touch valuators are set up below */
+        if (i >= CMT_AXIS_MT_POSITION_X && i <= CMT_AXIS_TOUCH_TIMESTAMP)
+            continue;
         xf86InitValuatorAxisStruct(
             dev, i, axes_labels[i], -1, -1, 1, 0, 1, mode);
         xf86InitValuatorDefaults(dev, i);
@@ -8,33 +8,74 @@
 #define _CMT_H_
 
 #include <linux/input.h>
+#include <pthread.h>
 
+#include <debuglog.h>
 #include <gesture.h>
 #include <properties.h>
+#include <recorder.h>
 // todo(denniskempin): allow libevdev to be included before X headers
 #include <libevdev/libevdev.h>
 
 #define DBG_VERB 7
+
+/* Set with ./configure --with-max-log-level */
+#ifndef CMT_MAX_LOG_LEVEL
+#define CMT_MAX_LOG_LEVEL DBG_VERB
+#endif
+
+/*
+ * Messages more verbose than CMT_MAX_LOG_LEVEL are compiled out. The rest
+ * are only formatted, and their arguments only evaluated, when the server
+ * runs at a verbosity that logs them.
+ */
+#define CMT_LOG_ENABLED(verb) \
+    ((verb) <= CMT_MAX_LOG_LEVEL && xf86GetVerbosity() >= (verb))
+
+#define CMT_LOG_VERB(info, type, verb, format, ...) \
+    do { \
+        if (CMT_LOG_ENABLED(verb)) \
+            xf86IDrvMsgVerb((info), (type), (verb), "%s():%d: " format, \
+                __FUNCTION__, __LINE__, ##__VA_ARGS__); \
+    } while (0)
+
 #define DBG(info, format, ...) \
-    xf86IDrvMsgVerb((info), X_INFO, DBG_VERB, "%s():%d: " format, \
-        __FUNCTION__, __LINE__, ##__VA_ARGS__)
+    CMT_LOG_VERB((info), X_INFO, DBG_VERB, format, ##__VA_ARGS__)
 
 #define PROBE_DBG(info, format, ...) \
-    xf86IDrvMsgVerb((info), X_PROBED, DBG_VERB, "%s():%d: " format, \
-        __FUNCTION__, __LINE__, ##__VA_ARGS__)
+    CMT_LOG_VERB((info), X_PROBED, DBG_VERB, format, ##__VA_ARGS__)
 
 #define CONFIG_DBG(info, format, ...) \
-    xf86IDrvMsgVerb((info), X_CONFIG, DBG_VERB, "%s():%d: " format, \
-        __FUNCTION__, __LINE__, ##__VA_ARGS__)
+    CMT_LOG_VERB((info), X_CONFIG, DBG_VERB, format, ##__VA_ARGS__)
 
 #define ERR(info, ...) \
         xf86IDrvMsg((info), X_ERROR, ##__VA_ARGS__)
 
+/*
+ * Servers with an input thread call ReadInput on it, while property
+ * handlers and device control still run on the main thread. State shared
+ * between the two, including the gestures interpreter, is only touched
+ * with the input lock held. Servers before 1.19 (XInput ABI 23) read
+ * input on the main thread.
+ */
+#if GET_ABI_MAJOR(ABI_XINPUT_VERSION) >= 23
+#define HAVE_THREADED_INPUT 1
+#else
+#define input_lock() do { } while (0)
+#define input_unlock() do { } while (0)
+#endif
+
 #define LONG_BITS (sizeof(long) * 8)
 
 /* Number of longs needed to hold the given number of bits */
 #define NLONGS(x) (((x) + LONG_BITS - 1) / LONG_BITS)
 
+#define CMT_CACHE_LINE 64
+
+/* Round a size up to a whole number of cache lines */
+#define CMT_CACHE_ALIGN(x) \
+    (((x) + CMT_CACHE_LINE - 1) & ~(size_t)(CMT_CACHE_LINE - 1))
+
 /* Axes numbers. */
 enum CMT_AXIS {
     CMT_AXIS_X = 0,
@@ -56,10 +97,12 @@ enum CMT_AXIS {
     CMT_AXIS_MT_POSITION_Y,
     CMT_AXIS_MT_PRESSURE,
     CMT_AXIS_MT_TOUCH_MAJOR,
-    CMT_AXIS_TOUCH_TIMESTAMP
+    CMT_AXIS_TOUCH_TIMESTAMP,
+    CMT_AXIS_DBL_PINCH_DZ,
+    CMT_AXIS_DBL_PINCH_ORDINAL_DZ
 };
 
-#define CMT_NUM_AXES (CMT_AXIS_TOUCH_TIMESTAMP - CMT_AXIS_X + 1)
+#define CMT_NUM_AXES (CMT_AXIS_DBL_PINCH_ORDINAL_DZ - CMT_AXIS_X + 1)
 #define CMT_NUM_MT_AXES (CMT_AXIS_TOUCH_TIMESTAMP - CMT_AXIS_MT_POSITION_X + 1)
 
 /* Button numbers. */
@@ -73,16 +116,62 @@ enum CMT_BUTTON {
 
 #define CMT_NUM_BUTTONS (CMT_BTN_FORWARD - CMT_BTN_LEFT + 1)
 
+/* ReadInput statistics, in the order exported by the Read Statistics prop */
+enum CMT_READ_STAT {
+    CMT_READ_STAT_WAKEUPS = 0,
+    CMT_READ_STAT_READS,
+    CMT_READ_STAT_FRAMES,
+    CMT_READ_STAT_MAX_FRAMES,  /* Most frames handled in a single wakeup */
+    CMT_READ_STAT_BUDGET_EXHAUSTED
+};
+
+#define CMT_NUM_READ_STATS (CMT_READ_STAT_BUDGET_EXHAUSTED + 1)
+
+/*
+ * Performance counters, in the order exported by the Performance Counters
+ * prop. Frames, reads and timer fires are copied from the read and timer
+ * statistics when the prop is read.
+ */
+enum CMT_PERF_COUNTER {
+    CMT_PERF_FRAMES = 0,
+    CMT_PERF_READS,         /* EvdevRead calls that returned data */
+    CMT_PERF_READ_ERRORS,
+    CMT_PERF_SYN_DROPPED,   /* Kernel buffer overruns */
+    CMT_PERF_HWSTATES,      /* Hardware states pushed to the interpreter */
+    CMT_PERF_TOUCH_EVENTS,
+    CMT_PERF_KEY_EVENTS,
+    CMT_PERF_TIMER_FIRES,
+    CMT_PERF_GESTURES       /* One counter per gesture type, then others */
+};
+
+#define CMT_PERF_GESTURE_TYPES (kGestureTypeMetrics + 1)
+#define CMT_NUM_PERF_COUNTERS (CMT_PERF_GESTURES + CMT_PERF_GESTURE_TYPES + 1)
+
 typedef struct {
     CmtProperties props;
     EventStateRec evstate;
     GestureRec gesture;
-    GesturesProp* prop_list;
+    GesturesProp** prop_table;  /* Hash table of properties, by atom */
+    size_t prop_table_size;
+    size_t prop_count;
+    struct PropSlab* prop_slabs;   /* Arena backing the GesturesProp records */
+    GesturesProp* prop_free_list;  /* Records released by Prop_Free */
+    Bool props_deferred;  /* Properties not yet sent to the server */
+    GesturesProp* props_pending;       /* Deferred, in creation order */
+    GesturesProp* props_pending_tail;
+    Bool props_publishing; /* Sending deferred properties */
     Evdev evdev;
+    size_t debug_buf_seen;  /* Next evdev.debug_buf entry to scan */
 
     char* device;
     long  handlers;
     unsigned long prev_key_state[NLONGS(KEY_CNT)];
+    int read_stats[CMT_NUM_READ_STATS];
+    int perf_counters[CMT_NUM_PERF_COUNTERS];
+    RecorderRec recorder;
+    int dump_stats[CMT_NUM_DUMP_STATS];  /* Written by the dump thread */
+    pthread_t dump_thread;
+    Bool dump_thread_valid;  /* dump_thread has not been joined yet */
 } CmtDeviceRec, *CmtDevicePtr;
 
 #endif
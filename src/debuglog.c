@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "debuglog.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmt.h"
+
+/*
+ * Copy of the device state the writer thread works from. The live Evdev
+ * keeps changing on the main thread while the dump is written.
+ */
+typedef struct {
+    Evdev evdev;
+    EventStateRec evstate;
+    int* stats;
+} DebugLogSnapshot;
+
+/*
+ * All devices dump to the same file, so only one dump is written at a time.
+ */
+static pthread_mutex_t debuglog_write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The X log is not safe to use off the main thread, so the copy gets a
+ * logger that drops everything.
+ */
+static void
+DebugLog_Null(void* udata, int level, const char* format, ...)
+{
+}
+
+static void
+DebugLog_SnapshotFree(DebugLogSnapshot* snap)
+{
+    if (!snap)
+        return;
+    free(snap->evstate.slots);
+    free(snap);
+}
+
+static DebugLogSnapshot*
+DebugLog_Snapshot(CmtDevicePtr cmt)
+{
+    DebugLogSnapshot* snap;
+    size_t slots_size;
+
+    snap = malloc(sizeof(*snap));
+    if (!snap)
+        return NULL;
+
+    memcpy(&snap->evdev, &cmt->evdev, sizeof(snap->evdev));
+    snap->evdev.fd = -1;
+    snap->evdev.log = DebugLog_Null;
+    snap->evdev.log_udata = NULL;
+    snap->evdev.syn_report = NULL;
+    snap->evdev.syn_report_udata = NULL;
+
+    snap->evstate = cmt->evstate;
+    snap->evstate.slots = NULL;
+    snap->evstate.slot_current = NULL;
+    if (cmt->evstate.slots) {
+        slots_size = cmt->evstate.slot_count * sizeof(*cmt->evstate.slots);
+        snap->evstate.slots = malloc(slots_size);
+        if (!snap->evstate.slots) {
+            free(snap);
+            return NULL;
+        }
+        memcpy(snap->evstate.slots, cmt->evstate.slots, slots_size);
+        if (cmt->evstate.slot_current)
+            snap->evstate.slot_current = snap->evstate.slots +
+                (cmt->evstate.slot_current - cmt->evstate.slots);
+    }
+    snap->evdev.evstate = &snap->evstate;
+    snap->stats = cmt->dump_stats;
+    return snap;
+}
+
+static void
+DebugLog_Write(Evdev* evdev)
+{
+    pthread_mutex_lock(&debuglog_write_lock);
+    Event_Dump_Debug_Log(evdev);
+    pthread_mutex_unlock(&debuglog_write_lock);
+}
+
+static void*
+DebugLog_Writer(void* data)
+{
+    DebugLogSnapshot* snap = data;
+    int* stats = snap->stats;
+    CARD64 start = GetTimeInMicros();
+
+    DebugLog_Write(&snap->evdev);
+    DebugLog_SnapshotFree(snap);
+
+    __atomic_store_n(&stats[CMT_DUMP_STAT_WRITE_US],
+                     (int)(GetTimeInMicros() - start), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats[CMT_DUMP_STAT_COMPLETED], 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats[CMT_DUMP_STAT_STATE], CMT_DUMP_STATE_DONE,
+                     __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/*
+ * Reap the previous writer thread. Returns FALSE if it is still writing.
+ */
+static Bool
+DebugLog_Join(CmtDevicePtr cmt, Bool wait)
+{
+    if (!cmt->dump_thread_valid)
+        return TRUE;
+
+    if (!wait &&
+        __atomic_load_n(&cmt->dump_stats[CMT_DUMP_STAT_STATE],
+                        __ATOMIC_ACQUIRE) == CMT_DUMP_STATE_WRITING)
+        return FALSE;
+
+    pthread_join(cmt->dump_thread, NULL);
+    cmt->dump_thread_valid = FALSE;
+    return TRUE;
+}
+
+/*
+ * Write the dump on the calling thread, from the snapshot if there is one.
+ * Only without a snapshot does the input thread wait for the write. The
+ * caller must not hold the input lock, which is recursive.
+ */
+static void
+DebugLog_DumpSync(CmtDevicePtr cmt, DebugLogSnapshot* snap)
+{
+    CARD64 start = GetTimeInMicros();
+
+    if (snap) {
+        DebugLog_Write(&snap->evdev);
+        DebugLog_SnapshotFree(snap);
+    } else {
+        input_lock();
+        DebugLog_Write(&cmt->evdev);
+        input_unlock();
+    }
+    cmt->dump_stats[CMT_DUMP_STAT_WRITE_US] = GetTimeInMicros() - start;
+    cmt->dump_stats[CMT_DUMP_STAT_COMPLETED]++;
+    cmt->dump_stats[CMT_DUMP_STAT_STATE] = CMT_DUMP_STATE_DONE;
+}
+
+void
+DebugLog_Dump(void* data)
+{
+    InputInfoPtr info = data;
+    CmtDevicePtr cmt = info->private;
+    CARD64 start = GetTimeInMicros();
+    DebugLogSnapshot* snap = NULL;
+    sigset_t all;
+    sigset_t old;
+    int rc = -1;
+
+    if (!DebugLog_Join(cmt, FALSE)) {
+        xf86IDrvMsg(info, X_WARNING, "Debug log dump already in progress\n");
+        return;
+    }
+
+    /* The input thread keeps appending to the log while it is copied */
+    input_lock();
+    snap = DebugLog_Snapshot(cmt);
+    input_unlock();
+
+    if (snap && cmt->props.dump_debug_log_async) {
+        cmt->dump_stats[CMT_DUMP_STAT_STATE] = CMT_DUMP_STATE_WRITING;
+
+        /* Leave signal delivery, e.g. SIGIO, to the server threads */
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        rc = pthread_create(&cmt->dump_thread, NULL, DebugLog_Writer, snap);
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+        if (rc == 0) {
+            cmt->dump_thread_valid = TRUE;
+            snap = NULL;
+        } else {
+            ERR(info, "Could not start debug log writer, dumping inline\n");
+        }
+    }
+
+    if (rc != 0)
+        DebugLog_DumpSync(cmt, snap);
+
+    xf86IDrvMsg(info, X_INFO, "Debug log dump blocked for %llu us (%s)\n",
+                (unsigned long long)(GetTimeInMicros() - start),
+                rc == 0 ? "async" : "sync");
+}
+
+void
+DebugLog_Close(InputInfoPtr info)
+{
+    CmtDevicePtr cmt = info->private;
+
+    DebugLog_Join(cmt, TRUE);
+}
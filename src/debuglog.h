@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef _DEBUGLOG_H_
+#define _DEBUGLOG_H_
+
+#include <xorg-server.h>
+#include <xf86.h>
+#include <xf86Xinput.h>
+
+/*
+ * Dumping the libevdev debug log copies the log under the input lock and
+ * writes the copy out afterwards, so the input thread does not stall while
+ * the file is written. With Dump Debug Log Async set, the copy is written
+ * by a separate thread and the main thread does not stall either. Dumps
+ * from different devices are written one at a time.
+ */
+
+/* Dump state, the first value of the Dump Debug Log Status property */
+enum CMT_DUMP_STATE {
+    CMT_DUMP_STATE_IDLE = 0,
+    CMT_DUMP_STATE_WRITING,
+    CMT_DUMP_STATE_DONE
+};
+
+/* Values of the Dump Debug Log Status property */
+enum CMT_DUMP_STAT {
+    CMT_DUMP_STAT_STATE = 0,
+    CMT_DUMP_STAT_COMPLETED,  /* Dumps written since the device was added */
+    CMT_DUMP_STAT_WRITE_US    /* Time the last dump took to write */
+};
+
+#define CMT_NUM_DUMP_STATS (CMT_DUMP_STAT_WRITE_US + 1)
+
+/*
+ * Set handler of the Dump Debug Log property, data is the InputInfoPtr.
+ * Runs without the input lock held.
+ */
+void DebugLog_Dump(void* data);
+
+/* Wait for a dump in progress to finish */
+void DebugLog_Close(InputInfoPtr info);
+
+#endif
@@ -6,6 +6,8 @@
 
 #include "gesture.h"
 
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include <gestures/gestures.h>
@@ -13,6 +15,7 @@
 
 #include "cmt.h"
 #include "properties.h"
+#include "timer.h"
 
 // Helper for bit operations
 #define LONG_BITS (sizeof(long) * 8)
@@ -23,6 +26,13 @@ static inline bool TestBit(int bit, unsigned long* array)
     return !!(array[bit / LONG_BITS] & (1L << (bit % LONG_BITS)));
 }
 
+// Only timerfd based timers run on the input thread, so default to them there
+#ifdef HAVE_THREADED_INPUT
+#define CMT_HIRES_TIMERS_DEFAULT TRUE
+#else
+#define CMT_HIRES_TIMERS_DEFAULT FALSE
+#endif
+
 // This array maps input_event button types to gestures buttons
 #define EVDEV_BUTTON_MAP_SIZE 7
 static const int kEvdevButtonMap[EVDEV_BUTTON_MAP_SIZE][2] = {
@@ -38,67 +48,70 @@ static const int kEvdevButtonMap[EVDEV_BUTTON_MAP_SIZE][2] = {
 // Conversion from kernel key codes to xorg key codes
 #define MIN_KEYCODE 8
 
-/*
- * Gestures timer functions
- */
-static GesturesTimer* Gesture_TimerCreate(void*);
-static void Gesture_TimerSet(void*,
-                             GesturesTimer*,
-                             stime_t,
-                             GesturesTimerCallback,
-                             void*);
-static void Gesture_TimerCancel(void*, GesturesTimer*);
-static void Gesture_TimerFree(void*, GesturesTimer*);
-
-static CARD32 Gesture_TimerCallback(OsTimerPtr, CARD32, pointer);
-
-struct GesturesTimer {
-    OsTimerPtr timer;
-    GesturesTimerCallback callback;
-    void* callback_data;
-    int is_monotonic:1;
-};
-
-static GesturesTimerProvider Gesture_GesturesTimerProvider = {
-    .create_fn = Gesture_TimerCreate,
-    .set_fn = Gesture_TimerSet,
-    .cancel_fn = Gesture_TimerCancel,
-    .free_fn = Gesture_TimerFree
-};
-
-/*
- * Callback for Gestures library.
- */
-static void Gesture_Gesture_Ready(void* client_data,
-                                  const struct Gesture* gesture);
+/* Buttons the driver posts events for */
+#define GESTURE_POSTED_BUTTONS \
+    (GESTURES_BUTTON_LEFT | GESTURES_BUTTON_MIDDLE | GESTURES_BUTTON_RIGHT | \
+     GESTURES_BUTTON_BACK | GESTURES_BUTTON_FORWARD)
 
 static enum GestureInterpreterDeviceClass Gesture_Device_Class(EvdevClass cls);
+static GestureFrameFunc Gesture_Frame_Handler(EvdevPtr evdev);
 
 int
-Gesture_Init(GesturePtr rec, size_t max_fingers)
+Gesture_Init(GesturePtr rec)
 {
     rec->interpreter = NewGestureInterpreter();
     rec->slot_states = NULL;
+    rec->prev_slots = NULL;
+    rec->fingers = NULL;
 
     if (!rec->interpreter)
         return !Success;
-    rec->fingers = malloc(max_fingers * sizeof(struct FingerState));
-    if (!rec->fingers)
-        goto Error_Alloc_Fingers;
     rec->mask = valuator_mask_new(MAX_VALUATORS);
     if (!rec->mask)
         goto Error_Alloc_Mask;
     return Success;
 
 Error_Alloc_Mask:
-    free(rec->fingers);
-    rec->fingers = NULL;
-Error_Alloc_Fingers:
     DeleteGestureInterpreter(rec->interpreter);
     rec->interpreter = NULL;
     return BadAlloc;
 }
 
+static void
+Gesture_Free_Slots(GesturePtr rec)
+{
+    /* fingers is the start of the block holding all per-slot arrays */
+    free(rec->fingers);
+    rec->fingers = NULL;
+    rec->prev_slots = NULL;
+    rec->slot_states = NULL;
+}
+
+/*
+ * Allocate the per-slot arrays the frame path walks as one block, each
+ * array starting on its own cache line.
+ */
+static Bool
+Gesture_Alloc_Slots(GesturePtr rec, int slot_count)
+{
+    size_t fingers_size = CMT_CACHE_ALIGN(slot_count *
+                                          sizeof(struct FingerState));
+    size_t slots_size = CMT_CACHE_ALIGN(slot_count * sizeof(MtSlotRec));
+    size_t states_size = CMT_CACHE_ALIGN(slot_count * sizeof(int));
+    size_t size = fingers_size + slots_size + states_size;
+    char* block;
+
+    /* Mice have no slots, but the frame path needs slot_states set */
+    if (posix_memalign((void**)&block, CMT_CACHE_LINE,
+                       size ? size : CMT_CACHE_LINE))
+        return FALSE;
+
+    rec->fingers = (struct FingerState*)block;
+    rec->prev_slots = (MtSlotPtr)(block + fingers_size);
+    rec->slot_states = (int*)(block + fingers_size + slots_size);
+    return TRUE;
+}
+
 void
 Gesture_Free(GesturePtr rec)
 {
@@ -108,15 +121,7 @@ Gesture_Free(GesturePtr rec)
     rec->dev = NULL;
 
     valuator_mask_free(&rec->mask);
-
-    if (rec->fingers) {
-        free(rec->fingers);
-        rec->fingers = NULL;
-    }
-    if(rec->slot_states) {
-        free(rec->slot_states);
-        rec->slot_states = NULL;
-    }
+    Gesture_Free_Slots(rec);
 }
 
 void
@@ -132,6 +137,16 @@ Gesture_Device_Init(GesturePtr rec, DeviceIntPtr dev)
 
     /* Store the device for which to generate gestures */
     rec->dev = dev;
+    rec->process_frame = Gesture_Frame_Handler(evdev);
+
+    /*
+     * The server timer list only has millisecond resolution, timerfd based
+     * timers fire on the exact deadline the interpreter asked for, and on
+     * the input thread when there is one.
+     */
+    rec->hires_timers = xf86SetBoolOption(info->options,
+                                          "High Resolution Timers",
+                                          CMT_HIRES_TIMERS_DEFAULT);
 
     /* TODO: support different models */
     hwprops.left            = props->area_left;
@@ -160,8 +175,8 @@ Gesture_Device_Init(GesturePtr rec, DeviceIntPtr dev)
             Gesture_Device_Class(cmt->evdev.info.evdev_class));
     GestureInterpreterSetHardwareProperties(rec->interpreter, &hwprops);
 
-    rec->slot_states = malloc(sizeof(int) * evstate->slot_count);
-    if (!rec->slot_states) {
+    Gesture_Free_Slots(rec);
+    if (!Gesture_Alloc_Slots(rec, evstate->slot_count)) {
         ERR(info, "BadAlloc: rec->slot_states");
         return;
     }
@@ -172,122 +187,267 @@ Gesture_Device_Init(GesturePtr rec, DeviceIntPtr dev)
 void
 Gesture_Device_On(GesturePtr rec)
 {
+    input_lock();
     GestureInterpreterSetTimerProvider(rec->interpreter,
-                                       &Gesture_GesturesTimerProvider,
+                                       rec->hires_timers ?
+                                           &hires_timer_provider :
+                                           &timer_provider,
                                        rec->dev);
     GestureInterpreterSetCallback(rec->interpreter, &Gesture_Gesture_Ready,
                                   rec);
+    input_unlock();
 }
 
 void
 Gesture_Device_Off(GesturePtr rec)
 {
+    input_lock();
     GestureInterpreterSetCallback(rec->interpreter, NULL, NULL);
+    rec->coalesced_valid = FALSE;
+    rec->batch_pending = FALSE;
+    input_unlock();
 }
 
 void
 Gesture_Device_Close(GesturePtr rec)
 {
+    input_lock();
     GestureInterpreterSetPropProvider(rec->interpreter, NULL, NULL);
     GestureInterpreterSetTimerProvider(rec->interpreter, NULL, NULL);
+    input_unlock();
 }
 
-void
-Gesture_Process_Slots(void* vrec,
-                      EventStatePtr evstate,
-                      struct timeval* tv)
+/*
+ * Post key events for every key whose state changed since the last frame.
+ * Key state almost never changes on a touchpad, so the diff is scanned a
+ * word at a time and only the set bits of non-zero words are visited.
+ */
+static void
+Gesture_Process_Keys(DeviceIntPtr dev,
+                     const unsigned long* key_state,
+                     unsigned long* prev_key_state)
 {
-    GesturePtr rec = vrec;
-    DeviceIntPtr dev = rec->dev;
     InputInfoPtr info = dev->public.devicePrivate;
     CmtDevicePtr cmt = info->private;
-    EvdevPtr evdev = &cmt->evdev;
-    ValuatorMask* mask = rec->mask;
-    int i;
-    MtSlotPtr slot;
-    struct HardwareState hwstate = { 0 };
-    int current_finger;
-    bool has_gesture_fingers = false;
     unsigned long key_state_diff[NLONGS(KEY_CNT)];
+    unsigned long changed = 0;
+    unsigned long diff;
+    int i;
+    int bit;
     int code;
     int value;
 
-    if (!rec->interpreter || ! rec->slot_states)
+    for (i = 0; i < NLONGS(KEY_CNT); ++i) {
+        key_state_diff[i] = key_state[i] ^ prev_key_state[i];
+        changed |= key_state_diff[i];
+    }
+    if (!changed)
         return;
 
-    /* handle changed keys */
+    /* Key and button changes end a batch of mouse frames */
+    Gesture_Flush_Batch(&cmt->gesture);
+
     for (i = 0; i < NLONGS(KEY_CNT); ++i) {
-        key_state_diff[i] = evdev->key_state_bitmask[i] ^
-                            cmt->prev_key_state[i];
-    }
-    for (i = 0; i < KEY_CNT; ++i) {
-        if (TestBit(i, key_state_diff)) {
-            code = i + MIN_KEYCODE;
-            value = TestBit(i, evdev->key_state_bitmask);
+        for (diff = key_state_diff[i]; diff; diff &= diff - 1) {
+            bit = __builtin_ctzl(diff);
+            code = i * LONG_BITS + bit + MIN_KEYCODE;
+            value = !!(key_state[i] & (1UL << bit));
             xf86PostKeyboardEvent(dev, code, value);
+            cmt->perf_counters[CMT_PERF_KEY_EVENTS]++;
         }
+        prev_key_state[i] = key_state[i];
     }
-    for (i = 0; i < NLONGS(KEY_CNT); ++i) {
-        cmt->prev_key_state[i] = evdev->key_state_bitmask[i];
+}
+
+/*
+ * Account for events posted while processing the current frame, measured
+ * from the kernel timestamp of the frame. Events posted from gesture timers
+ * have no frame to be measured against and are not counted.
+ */
+static void
+Gesture_Latency_Record(GesturePtr rec, int events)
+{
+    InputInfoPtr info = rec->dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
+    CARD64 us;
+    stime_t now;
+    int bucket;
+
+    if (!events || !rec->frame_time)
+        return;
+
+    now = Timer_Now(cmt->evdev.info.is_monotonic);
+    us = now > rec->frame_time ? (now - rec->frame_time) * 1000000.0 : 0;
+    bucket = us < 2 ? 0 : 63 - __builtin_clzll(us);
+    if (bucket >= CMT_LATENCY_BUCKETS)
+        bucket = CMT_LATENCY_BUCKETS - 1;
+    rec->latency[CMT_LATENCY_STAT_BUCKET0 + bucket] += events;
+}
+
+void
+Gesture_Latency_Update(GesturePtr rec)
+{
+    static const int percentiles[] = { 50, 95, 99 };
+    int* buckets = &rec->latency[CMT_LATENCY_STAT_BUCKET0];
+    CARD64 total = 0;
+    CARD64 target;
+    CARD64 seen;
+    int i;
+    int p;
+
+    for (i = 0; i < CMT_LATENCY_BUCKETS; i++)
+        total += (unsigned)buckets[i];
+    rec->latency[CMT_LATENCY_STAT_COUNT] = total;
+
+    for (p = 0; p < 3; p++) {
+        target = (total * percentiles[p] + 99) / 100;
+        seen = 0;
+        for (i = 0; i < CMT_LATENCY_BUCKETS - 1; i++) {
+            seen += (unsigned)buckets[i];
+            if (seen >= target)
+                break;
+        }
+        rec->latency[CMT_LATENCY_STAT_P50_US + p] = total ? 2 << i : 0;
     }
-    /* zero initialize all FingerStates to clear out previous state. */
-    memset(rec->fingers, 0,
-           Event_Get_Slot_Count(evdev) * sizeof(struct FingerState));
+}
+
+void
+Gesture_Latency_Reset(GesturePtr rec)
+{
+    memset(rec->latency, 0, sizeof(rec->latency));
+}
+
+/*
+ * Convert an active slot into the next FingerState handed to the
+ * interpreter. Only active slots are written, fields the slot does not
+ * provide are zeroed by the initializer.
+ */
+static void
+Gesture_Convert_Finger(struct FingerState* finger, MtSlotPtr slot)
+{
+    *finger = (struct FingerState) {
+        .touch_major = (float)slot->touch_major,
+        .touch_minor = (float)slot->touch_minor,
+        .width_major = (float)slot->width_major,
+        .width_minor = (float)slot->width_minor,
+        .pressure    = (float)slot->pressure,
+        .orientation = (float)slot->orientation,
+        .position_x  = (float)slot->position_x,
+        .position_y  = (float)slot->position_y,
+        .tracking_id = slot->tracking_id
+    };
+}
+
+/*
+ * Compare a raw slot with the values last posted for it. Slots whose
+ * position, pressure and touch major are all within the deadband need no
+ * new XI_TouchUpdate.
+ */
+static inline Bool
+Gesture_Raw_Slot_Unchanged(MtSlotPtr last, MtSlotPtr slot, int deadband)
+{
+    return slot->tracking_id == last->tracking_id &&
+           abs(slot->position_x - last->position_x) <= deadband &&
+           abs(slot->position_y - last->position_y) <= deadband &&
+           abs(slot->pressure - last->pressure) <= deadband &&
+           abs(slot->touch_major - last->touch_major) <= deadband;
+}
+
+/*
+ * Raw touch passthrough: post every slot as an X touch event and keep the
+ * interpreter out of the way.
+ */
+static void
+Gesture_Frame_Raw(GesturePtr rec, EventStatePtr evstate, struct timeval* tv)
+{
+    DeviceIntPtr dev = rec->dev;
+    InputInfoPtr info = dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
+    ValuatorMask* mask = rec->mask;
+    struct HardwareState hwstate = { 0 };
+    MtSlotPtr slot;
+    int posted = 0;
+    bool has_gesture_fingers = false;
+    int i;
 
     /* clear out previous state from valuator */
     valuator_mask_zero(mask);
 
-    if (cmt->props.raw_passthrough) {
-        for (i = 0; i < evstate->slot_count; i++) {
-            slot = &evstate->slots[i];
-
-            /* send TouchEnd for lifted fingers */
-            if (slot->tracking_id == -1) {
-                if (rec->slot_states[i] == SLOT_STATUS_RAW) {
-                    xf86PostTouchEvent(dev, i, XI_TouchEnd, 0, mask);
-                }
-                rec->slot_states[i] = SLOT_STATUS_FREE;
-                continue;
-            }
-
-            /*
-             * valuators 0 (CMT_AXIS_X) and 1 (CMT_AXIS_Y) are hardcoded into
-             * X.org as finger position, so we need to set those too.
-             */
-            valuator_mask_set_double(mask, CMT_AXIS_MT_POSITION_X,
-                                     slot->position_x);
-            valuator_mask_set_double(mask, CMT_AXIS_MT_POSITION_Y,
-                                     slot->position_y);
-            valuator_mask_set_double(mask, CMT_AXIS_MT_PRESSURE,
-                                     slot->pressure);
-            valuator_mask_set_double(mask, CMT_AXIS_MT_TOUCH_MAJOR,
-                                     slot->touch_major);
-            valuator_mask_set_double(mask, CMT_AXIS_TOUCH_TIMESTAMP,
-                                     StimeFromTimeval(tv));
-            valuator_mask_set_double(mask, CMT_AXIS_X, slot->position_x);
-            valuator_mask_set_double(mask, CMT_AXIS_Y, slot->position_y);
+    for (i = 0; i < evstate->slot_count; i++) {
+        slot = &evstate->slots[i];
 
+        /* send TouchEnd for lifted fingers */
+        if (slot->tracking_id == -1) {
             if (rec->slot_states[i] == SLOT_STATUS_RAW) {
-                xf86PostTouchEvent(dev, i, XI_TouchUpdate, 0, mask);
-            } else {
-                /* take over STATUS_GESTURE slots too */
-                if (rec->slot_states[i] == SLOT_STATUS_GESTURE)
-                    has_gesture_fingers = true;
-                xf86PostTouchEvent(dev, i, XI_TouchBegin, 0, mask);
-
+                xf86PostTouchEvent(dev, i, XI_TouchEnd, 0, mask);
+                posted++;
             }
-            rec->slot_states[i] = SLOT_STATUS_RAW;
+            rec->slot_states[i] = SLOT_STATUS_FREE;
+            continue;
         }
 
-        if (has_gesture_fingers) {
-            /* push empty hardware state to clear interpreter state */
-            hwstate.timestamp = StimeFromTimeval(tv);
-            GestureInterpreterPushHardwareState(rec->interpreter, &hwstate);
+        if (rec->slot_states[i] == SLOT_STATUS_RAW &&
+            cmt->props.raw_touch_skip_unchanged &&
+            Gesture_Raw_Slot_Unchanged(&rec->prev_slots[i], slot,
+                                       cmt->props.raw_touch_deadband)) {
+            cmt->props.raw_touch_suppressed++;
+            continue;
         }
-        return;
+
+        /*
+         * valuators 0 (CMT_AXIS_X) and 1 (CMT_AXIS_Y) are hardcoded into
+         * X.org as finger position, so we need to set those too.
+         */
+        valuator_mask_set_double(mask, CMT_AXIS_MT_POSITION_X,
+                                 slot->position_x);
+        valuator_mask_set_double(mask, CMT_AXIS_MT_POSITION_Y,
+                                 slot->position_y);
+        valuator_mask_set_double(mask, CMT_AXIS_MT_PRESSURE,
+                                 slot->pressure);
+        valuator_mask_set_double(mask, CMT_AXIS_MT_TOUCH_MAJOR,
+                                 slot->touch_major);
+        valuator_mask_set_double(mask, CMT_AXIS_TOUCH_TIMESTAMP,
+                                 StimeFromTimeval(tv));
+        valuator_mask_set_double(mask, CMT_AXIS_X, slot->position_x);
+        valuator_mask_set_double(mask, CMT_AXIS_Y, slot->position_y);
+
+        if (rec->slot_states[i] == SLOT_STATUS_RAW) {
+            xf86PostTouchEvent(dev, i, XI_TouchUpdate, 0, mask);
+        } else {
+            /* take over STATUS_GESTURE slots too */
+            if (rec->slot_states[i] == SLOT_STATUS_GESTURE)
+                has_gesture_fingers = true;
+            xf86PostTouchEvent(dev, i, XI_TouchBegin, 0, mask);
+
+        }
+        posted++;
+        rec->slot_states[i] = SLOT_STATUS_RAW;
+        rec->prev_slots[i] = *slot;
+    }
+
+    if (has_gesture_fingers) {
+        /* push empty hardware state to clear interpreter state */
+        hwstate.timestamp = StimeFromTimeval(tv);
+        GestureInterpreterPushHardwareState(rec->interpreter, &hwstate);
+        cmt->perf_counters[CMT_PERF_HWSTATES]++;
     }
+    cmt->perf_counters[CMT_PERF_TOUCH_EVENTS] += posted;
+    Gesture_Latency_Record(rec, posted);
+}
+
+/*
+ * Fill hwstate with the fingers of all slots owned by the interpreter.
+ * libevdev updates the slots without telling us which ones changed, so
+ * every slot is checked; only the occupied ones are converted.
+ */
+static void
+Gesture_Frame_Fingers(GesturePtr rec, EventStatePtr evstate,
+                      struct HardwareState* hwstate)
+{
+    MtSlotPtr slot;
+    int current_finger = 0;
+    int i;
 
-    current_finger = 0;
     for (i = 0; i < evstate->slot_count; i++) {
         slot = &evstate->slots[i];
         if (slot->tracking_id == -1) {
@@ -302,32 +462,196 @@ Gesture_Process_Slots(void* vrec,
             continue;
         }
 
-        rec->fingers[current_finger].touch_major = (float)slot->touch_major;
-        rec->fingers[current_finger].touch_minor = (float)slot->touch_minor;
-        rec->fingers[current_finger].width_major = (float)slot->width_major;
-        rec->fingers[current_finger].width_minor = (float)slot->width_minor;
-        rec->fingers[current_finger].pressure    = (float)slot->pressure;
-        rec->fingers[current_finger].orientation = (float)slot->orientation;
-        rec->fingers[current_finger].position_x  = (float)slot->position_x;
-        rec->fingers[current_finger].position_y  = (float)slot->position_y;
-        rec->fingers[current_finger].tracking_id = slot->tracking_id;
-        current_finger++;
+        Gesture_Convert_Finger(&rec->fingers[current_finger++], slot);
     }
-    hwstate.timestamp = StimeFromTimeval(tv);
+    hwstate->finger_cnt = current_finger;
+    hwstate->fingers = rec->fingers;
+}
+
+static void
+Gesture_Frame_Buttons(EvdevPtr evdev, struct HardwareState* hwstate)
+{
+    int i;
 
     for (i = 0; i < EVDEV_BUTTON_MAP_SIZE; ++i) {
         if (Event_Get_Button(evdev, kEvdevButtonMap[i][0]))
-            hwstate.buttons_down |= kEvdevButtonMap[i][1];
+            hwstate->buttons_down |= kEvdevButtonMap[i][1];
     }
+}
 
-    hwstate.touch_cnt = Event_Get_Touch_Count(evdev);
-    hwstate.finger_cnt = current_finger;
-    hwstate.fingers = rec->fingers;
+static void
+Gesture_Frame_Push(GesturePtr rec, struct HardwareState* hwstate)
+{
+    InputInfoPtr info = rec->dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
+
+    GestureInterpreterPushHardwareState(rec->interpreter, hwstate);
+    cmt->perf_counters[CMT_PERF_HWSTATES]++;
+    Gesture_Flush_Coalesced(rec);
+}
+
+void
+Gesture_Flush_Batch(GesturePtr rec)
+{
+    stime_t frame_time = rec->frame_time;
+
+    if (!rec->batch_pending)
+        return;
+    rec->batch_pending = FALSE;
+
+    /* Latency is measured from the last frame merged into the batch */
+    rec->frame_time = rec->batch.timestamp;
+    Gesture_Frame_Push(rec, &rec->batch);
+    rec->frame_time = frame_time;
+}
+
+/*
+ * Merge a mouse frame into the batch pushed at the end of the wakeup.
+ * Frames that change buttons are pushed on their own.
+ */
+static void
+Gesture_Frame_Batch(GesturePtr rec, struct HardwareState* hwstate)
+{
+    InputInfoPtr info = rec->dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
+    struct HardwareState* batch = &rec->batch;
+
+    if (hwstate->buttons_down != rec->batch_buttons) {
+        Gesture_Flush_Batch(rec);
+        rec->batch_buttons = hwstate->buttons_down;
+        Gesture_Frame_Push(rec, hwstate);
+        return;
+    }
+
+    if (!rec->batch_pending) {
+        *batch = *hwstate;
+        rec->batch_pending = TRUE;
+        return;
+    }
+
+    batch->timestamp = hwstate->timestamp;
+    batch->rel_x += hwstate->rel_x;
+    batch->rel_y += hwstate->rel_y;
+    batch->rel_wheel += hwstate->rel_wheel;
+    batch->rel_hwheel += hwstate->rel_hwheel;
+    cmt->props.mouse_frames_batched++;
+}
+
+/*
+ * Frame handlers, one per device class, picked in Gesture_Device_Init.
+ * Each only gathers the hardware state its class can produce.
+ */
+
+/* Plain mice: buttons and relative motion, no slots */
+static void
+Gesture_Frame_Mouse(GesturePtr rec, EventStatePtr evstate, struct timeval* tv)
+{
+    InputInfoPtr info = rec->dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
+    struct HardwareState hwstate = { 0 };
+
+    if (cmt->props.raw_passthrough)
+        return;
+
+    hwstate.timestamp = StimeFromTimeval(tv);
+    Gesture_Frame_Buttons(&cmt->evdev, &hwstate);
+    hwstate.rel_x = evstate->rel_x;
+    hwstate.rel_y = evstate->rel_y;
+    hwstate.rel_wheel = evstate->rel_wheel;
+    hwstate.rel_hwheel = evstate->rel_hwheel;
+    if (cmt->props.mouse_batch_frames) {
+        Gesture_Frame_Batch(rec, &hwstate);
+    } else {
+        /* Batching may have just been turned off with a batch pending */
+        Gesture_Flush_Batch(rec);
+        Gesture_Frame_Push(rec, &hwstate);
+    }
+}
+
+/* Touchpads and touchscreens without relative axes: slots and buttons */
+static void
+Gesture_Frame_Touch(GesturePtr rec, EventStatePtr evstate, struct timeval* tv)
+{
+    InputInfoPtr info = rec->dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
+    struct HardwareState hwstate = { 0 };
+
+    if (cmt->props.raw_passthrough) {
+        Gesture_Frame_Raw(rec, evstate, tv);
+        return;
+    }
+
+    Gesture_Frame_Fingers(rec, evstate, &hwstate);
+    hwstate.timestamp = StimeFromTimeval(tv);
+    Gesture_Frame_Buttons(&cmt->evdev, &hwstate);
+    hwstate.touch_cnt = Event_Get_Touch_Count(&cmt->evdev);
+    Gesture_Frame_Push(rec, &hwstate);
+}
+
+/* Multitouch mice and anything else: all of the above */
+static void
+Gesture_Frame_Generic(GesturePtr rec, EventStatePtr evstate,
+                      struct timeval* tv)
+{
+    InputInfoPtr info = rec->dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
+    struct HardwareState hwstate = { 0 };
+
+    if (cmt->props.raw_passthrough) {
+        Gesture_Frame_Raw(rec, evstate, tv);
+        return;
+    }
+
+    Gesture_Frame_Fingers(rec, evstate, &hwstate);
+    hwstate.timestamp = StimeFromTimeval(tv);
+    Gesture_Frame_Buttons(&cmt->evdev, &hwstate);
+    hwstate.touch_cnt = Event_Get_Touch_Count(&cmt->evdev);
     hwstate.rel_x = evstate->rel_x;
     hwstate.rel_y = evstate->rel_y;
     hwstate.rel_wheel = evstate->rel_wheel;
     hwstate.rel_hwheel = evstate->rel_hwheel;
-    GestureInterpreterPushHardwareState(rec->interpreter, &hwstate);
+    Gesture_Frame_Push(rec, &hwstate);
+}
+
+static GestureFrameFunc
+Gesture_Frame_Handler(EvdevPtr evdev)
+{
+    int i;
+
+    switch (evdev->info.evdev_class) {
+    case EvdevClassMouse:
+        return Gesture_Frame_Mouse;
+    case EvdevClassTouchpad:
+    case EvdevClassTouchscreen:
+        /* Some have a wheel or pointing stick reporting relative motion */
+        for (i = 0; i < NLONGS(REL_CNT); i++)
+            if (evdev->info.rel_bitmask[i])
+                return Gesture_Frame_Generic;
+        return Gesture_Frame_Touch;
+    default:
+        return Gesture_Frame_Generic;
+    }
+}
+
+void
+Gesture_Process_Slots(void* vrec,
+                      EventStatePtr evstate,
+                      struct timeval* tv)
+{
+    GesturePtr rec = vrec;
+    InputInfoPtr info;
+    CmtDevicePtr cmt;
+
+    if (!rec->interpreter || ! rec->slot_states)
+        return;
+    info = rec->dev->public.devicePrivate;
+    cmt = info->private;
+
+    rec->frame_time = StimeFromTimeval(tv);
+    Gesture_Process_Keys(rec->dev, cmt->evdev.key_state_bitmask,
+                         cmt->prev_key_state);
+    rec->process_frame(rec, evstate, tv);
+    rec->frame_time = 0;
 }
 
 static void SetTimeValues(ValuatorMask* mask,
@@ -371,19 +695,16 @@ static void SetOrdinalValues(ValuatorMask* mask,
     valuator_mask_set_double(mask, CMT_AXIS_ORDINAL_Y, y);
 }
 
-static void Gesture_Gesture_Ready(void* client_data,
-                                  const struct Gesture* gesture)
+/*
+ * Post a gesture as X events, returns the number of events posted.
+ */
+static int
+Gesture_Post(GesturePtr rec, const struct Gesture* gesture)
 {
-    GesturePtr rec = client_data;
     DeviceIntPtr dev = rec->dev;
     ValuatorMask* mask = rec->mask;
     InputInfoPtr info = dev->public.devicePrivate;
-    CmtDevicePtr cmt = info->private;
-
-    if (cmt->props.raw_passthrough) {
-        DBG(info, "Gesture Suppressed");
-        return;
-    }
+    int posted = 1;
 
     DBG(info, "Gesture Start: %f End: %f \n",
         gesture->start_time, gesture->end_time);
@@ -392,6 +713,7 @@ static void Gesture_Gesture_Ready(void* client_data,
     switch (gesture->type) {
         case kGestureTypeContactInitiated:
             /* TODO(adlr): handle contact initiated */
+            posted = 0;
             break;
         case kGestureTypeMove: {
             const GestureMove* move = &gesture->details.move;
@@ -429,6 +751,9 @@ static void Gesture_Gesture_Ready(void* client_data,
             DBG(info, "Gesture Button Change: down=0x%02x up=0x%02x\n",
                 buttons->down, buttons->up);
             SetTimeValues(mask, gesture, dev, TRUE);
+            posted =
+                __builtin_popcount(buttons->down & GESTURE_POSTED_BUTTONS) +
+                __builtin_popcount(buttons->up & GESTURE_POSTED_BUTTONS);
             if (buttons->down & GESTURES_BUTTON_LEFT)
                 xf86PostButtonEventM(dev, TRUE, CMT_BTN_LEFT, 1, mask);
             if (buttons->down & GESTURES_BUTTON_MIDDLE)
@@ -497,6 +822,12 @@ static void Gesture_Gesture_Ready(void* client_data,
             const GesturePinch* pinch = &gesture->details.pinch;
             DBG(info, "Gesture Pinch: dz=%f [%f]\n",
                 pinch->dz, pinch->ordinal_dz);
+            valuator_mask_set_double(mask, CMT_AXIS_DBL_PINCH_DZ, pinch->dz);
+            valuator_mask_set_double(mask, CMT_AXIS_DBL_PINCH_ORDINAL_DZ,
+                                     pinch->ordinal_dz);
+            valuator_mask_set_double(mask, CMT_AXIS_FINGER_COUNT, 2.0);
+            SetTimeValues(mask, gesture, dev, TRUE);
+            xf86PostMotionEventM(dev, TRUE, mask);
             break;
         }
         case kGestureTypeMetrics: {
@@ -514,88 +845,84 @@ static void Gesture_Gesture_Ready(void* client_data,
         }
         default:
             ERR(info, "Unrecognized gesture type (%u)\n", gesture->type);
+            posted = 0;
             break;
     }
+    return posted;
 }
 
-static GesturesTimer*
-Gesture_TimerCreate(void* provider_data)
+void
+Gesture_Flush_Coalesced(GesturePtr rec)
 {
-    DeviceIntPtr dev = provider_data;
-    InputInfoPtr info = dev->public.devicePrivate;
-    CmtDevicePtr cmt = info->private;
-    GesturesTimer* timer = (GesturesTimer*)calloc(1, sizeof(GesturesTimer));
-    if (!timer)
-        return NULL;
-    timer->timer = TimerSet(NULL, 0, 0, NULL, 0);
-    if (!timer->timer) {
-        free(timer);
-        return NULL;
-    }
-    timer->is_monotonic = cmt->evdev.info.is_monotonic;
-    return timer;
+    if (!rec->coalesced_valid)
+        return;
+    rec->coalesced_valid = FALSE;
+    Gesture_Latency_Record(rec, Gesture_Post(rec, &rec->coalesced));
 }
 
-static void
-Gesture_TimerSet(void* provider_data,
-                 GesturesTimer* timer,
-                 stime_t delay,
-                 GesturesTimerCallback callback,
-                 void* callback_data)
+/*
+ * Fold a move or scroll into the one held back, if it has the same type.
+ * Returns FALSE for gestures that have to be posted right away.
+ */
+static Bool
+Gesture_Coalesce(GesturePtr rec, const struct Gesture* gesture)
 {
-    CARD32 ms = delay * 1000.0;
+    InputInfoPtr info = rec->dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
+    struct Gesture* held = &rec->coalesced;
 
-    if (!timer)
-        return;
-    timer->callback = callback;
-    timer->callback_data = callback_data;
-    if (ms == 0)
-        ms = 1;
-    TimerSet(timer->timer, 0, ms, Gesture_TimerCallback, timer);
-}
+    if (gesture->type != kGestureTypeMove &&
+        gesture->type != kGestureTypeScroll)
+        return FALSE;
 
-static void
-Gesture_TimerCancel(void* provider_data, GesturesTimer* timer)
-{
-    TimerCancel(timer->timer);
-}
+    if (!rec->coalesced_valid || held->type != gesture->type) {
+        Gesture_Flush_Coalesced(rec);
+        *held = *gesture;
+        rec->coalesced_valid = TRUE;
+        return TRUE;
+    }
 
-static void
-Gesture_TimerFree(void* provider_data, GesturesTimer* timer)
-{
-    TimerFree(timer->timer);
-    timer->timer = NULL;
-    free(timer);
+    if (gesture->type == kGestureTypeMove) {
+        held->details.move.dx += gesture->details.move.dx;
+        held->details.move.dy += gesture->details.move.dy;
+        held->details.move.ordinal_dx += gesture->details.move.ordinal_dx;
+        held->details.move.ordinal_dy += gesture->details.move.ordinal_dy;
+    } else {
+        held->details.scroll.dx += gesture->details.scroll.dx;
+        held->details.scroll.dy += gesture->details.scroll.dy;
+        held->details.scroll.ordinal_dx += gesture->details.scroll.ordinal_dx;
+        held->details.scroll.ordinal_dy += gesture->details.scroll.ordinal_dy;
+    }
+    held->end_time = gesture->end_time;
+    cmt->props.gestures_coalesced++;
+    return TRUE;
 }
 
-static CARD32
-Gesture_TimerCallback(OsTimerPtr timer,
-                      CARD32 millis,
-                      pointer callback_data)
+void
+Gesture_Gesture_Ready(void* client_data, const struct Gesture* gesture)
 {
-    GesturesTimer* tm = callback_data;
-    stime_t now;
-    stime_t rc;
-    CARD32 next_timeout = 0;
+    GesturePtr rec = client_data;
+    InputInfoPtr info = rec->dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
 
-    if (tm->is_monotonic) {
-      struct timespec ts;
-      clock_gettime(CLOCK_MONOTONIC, &ts);
-      now = StimeFromTimespec(&ts);
-    } else {
-      struct timeval tv;
-      gettimeofday(&tv, NULL);
-      now = StimeFromTimeval(&tv);
-    }
+    if (gesture->type >= 0 && gesture->type < CMT_PERF_GESTURE_TYPES)
+        cmt->perf_counters[CMT_PERF_GESTURES + gesture->type]++;
+    else
+        cmt->perf_counters[CMT_PERF_GESTURES + CMT_PERF_GESTURE_TYPES]++;
 
-    rc = tm->callback(now, tm->callback_data);
-    if (rc >= 0.0) {
-        next_timeout = rc * 1000.0;
-        if (next_timeout == 0)
-            next_timeout = 1;
+    if (cmt->props.raw_passthrough) {
+        /* A gesture held back before passthrough was turned on */
+        Gesture_Flush_Coalesced(rec);
+        DBG(info, "Gesture Suppressed");
+        return;
     }
 
-    return next_timeout;
+    if (cmt->props.coalesce_gestures && Gesture_Coalesce(rec, gesture))
+        return;
+
+    /* Whatever was held back happened first, post it first */
+    Gesture_Flush_Coalesced(rec);
+    Gesture_Latency_Record(rec, Gesture_Post(rec, gesture));
 }
 
 static enum GestureInterpreterDeviceClass
@@ -616,9 +943,11 @@ Gesture_Device_Class(EvdevClass cls) {
 
 _X_EXPORT void gestures_log(int verb, const char* fmt, ...) {
   va_list args;
+  if (verb > 0 && !CMT_LOG_ENABLED(DBG_VERB))
+    return;
   va_start(args, fmt);
   if (verb > 0)
-    xf86VDrvMsgVerb(-1, X_INFO, 7, fmt, args);
+    xf86VDrvMsgVerb(-1, X_INFO, DBG_VERB, fmt, args);
   else
     xf86VDrvMsgVerb(-1, X_ERROR, 0, fmt, args);
   va_end(args);
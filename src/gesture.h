@@ -23,15 +23,59 @@ enum SLOT_STATUS {
     SLOT_STATUS_GESTURE
 };
 
-typedef struct {
+/* Timer statistics, in the order exported by the Timer Lateness prop */
+enum CMT_TIMER_STAT {
+    CMT_TIMER_STAT_FIRES = 0,
+    CMT_TIMER_STAT_LATE_MEAN_US,
+    CMT_TIMER_STAT_LATE_MAX_US
+};
+
+#define CMT_NUM_TIMER_STATS (CMT_TIMER_STAT_LATE_MAX_US + 1)
+
+/*
+ * Input latency histogram, in the order exported by the Input Latency prop.
+ * Bucket 0 counts events posted less than 2us after their frame, bucket i
+ * the ones posted within [2^i, 2^(i+1)) us, the last bucket everything
+ * slower. Percentiles are reported as the upper bound of their bucket.
+ */
+#define CMT_LATENCY_BUCKETS 24
+
+enum CMT_LATENCY_STAT {
+    CMT_LATENCY_STAT_COUNT = 0,
+    CMT_LATENCY_STAT_P50_US,
+    CMT_LATENCY_STAT_P95_US,
+    CMT_LATENCY_STAT_P99_US,
+    CMT_LATENCY_STAT_BUCKET0
+};
+
+#define CMT_NUM_LATENCY_STATS (CMT_LATENCY_STAT_BUCKET0 + CMT_LATENCY_BUCKETS)
+
+typedef struct GestureRec* GesturePtr;
+
+/* Turns one evdev frame into a HardwareState, or raw touch events */
+typedef void (*GestureFrameFunc)(GesturePtr, EventStatePtr, struct timeval*);
+
+typedef struct GestureRec {
     GestureInterpreter* interpreter;  /* The interpreter from Gestures lib */
     DeviceIntPtr dev;
     struct FingerState *fingers;
     ValuatorMask *mask;
     int *slot_states;  /* Leep track of slot usage between syn reports */
-} GestureRec, *GesturePtr;
+    MtSlotPtr prev_slots;  /* Slot values last posted as raw */
+    Bool hires_timers;  /* Use timerfd instead of the server timer list */
+    int timer_stats[CMT_NUM_TIMER_STATS];
+    CARD64 timer_late_total_us;
+    stime_t frame_time;  /* Timestamp of the frame being processed, or 0 */
+    int latency[CMT_NUM_LATENCY_STATS];
+    struct Gesture coalesced;  /* Move or scroll held back for coalescing */
+    Bool coalesced_valid;
+    GestureFrameFunc process_frame;  /* Frame handler for the device class */
+    struct HardwareState batch;  /* Mouse frames merged in this wakeup */
+    Bool batch_pending;
+    int batch_buttons;  /* Buttons down in the last frame pushed or batched */
+} GestureRec;
 
-int Gesture_Init(GesturePtr, size_t);
+int Gesture_Init(GesturePtr);
 void Gesture_Free(GesturePtr);
 
 /*
@@ -60,4 +104,31 @@ void Gesture_Device_Close(GesturePtr);
  */
 void Gesture_Process_Slots(void*, EventStatePtr, struct timeval*);
 
+/*
+ * Callback for Gestures library, posts a gesture as X events.
+ */
+void Gesture_Gesture_Ready(void*, const struct Gesture*);
+
+/*
+ * Post the move or scroll held back by Coalesce Gestures, if any. Called
+ * at the end of every frame and gesture timer callback.
+ */
+void Gesture_Flush_Coalesced(GesturePtr);
+
+/*
+ * Push the mouse frames merged by Mouse Batch Frames, if any. Called at
+ * the end of every read wakeup.
+ */
+void Gesture_Flush_Batch(GesturePtr);
+
+/*
+ * Refresh the count and percentiles of the input latency histogram.
+ */
+void Gesture_Latency_Update(GesturePtr);
+
+/*
+ * Clear the input latency histogram.
+ */
+void Gesture_Latency_Reset(GesturePtr);
+
 #endif
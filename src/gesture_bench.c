@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <sys/time.h>
+
+/* Frames are reported at 1 kHz, like the fastest touchpads we support */
+#define FRAME_USEC 1000
+
+typedef struct {
+    const char* name;
+    BenchDevicePtr bd;
+    struct Gesture gesture;
+} BenchGestureRec, *BenchGesturePtr;
+
+static void
+NextFrame(struct timeval* tv)
+{
+    tv->tv_usec += FRAME_USEC;
+    if (tv->tv_usec >= 1000000) {
+        tv->tv_usec -= 1000000;
+        tv->tv_sec++;
+    }
+}
+
+/* One finger resting on the pad, no key changes between frames. */
+static void
+Bench_Frame_NoKeys(void* data, unsigned long iterations)
+{
+    BenchDevicePtr bd = data;
+    CmtDevicePtr cmt = &bd->cmt;
+    struct timeval tv = { 1, 0 };
+    unsigned long i;
+
+    cmt->evstate.slots[0].tracking_id = 1;
+    for (i = 0; i < iterations; i++) {
+        NextFrame(&tv);
+        Gesture_Process_Slots(&cmt->gesture, &cmt->evstate, &tv);
+    }
+    cmt->evstate.slots[0].tracking_id = -1;
+}
+
+/* One finger resting on the pad, BTN_TOUCH toggling every frame. */
+static void
+Bench_Frame_KeyToggle(void* data, unsigned long iterations)
+{
+    BenchDevicePtr bd = data;
+    CmtDevicePtr cmt = &bd->cmt;
+    struct timeval tv = { 1, 0 };
+    unsigned long i;
+
+    cmt->evstate.slots[0].tracking_id = 1;
+    for (i = 0; i < iterations; i++) {
+        cmt->evdev.key_state_bitmask[BTN_TOUCH / LONG_BITS] ^=
+            1UL << (BTN_TOUCH % LONG_BITS);
+        NextFrame(&tv);
+        Gesture_Process_Slots(&cmt->gesture, &cmt->evstate, &tv);
+    }
+    cmt->evstate.slots[0].tracking_id = -1;
+}
+
+/* A mouse moving one unit right per frame, no buttons held. */
+static void
+Bench_Frame_RelMove(void* data, unsigned long iterations)
+{
+    BenchDevicePtr bd = data;
+    CmtDevicePtr cmt = &bd->cmt;
+    struct timeval tv = { 1, 0 };
+    unsigned long i;
+
+    for (i = 0; i < iterations; i++) {
+        cmt->evstate.rel_x = 1;
+        NextFrame(&tv);
+        Gesture_Process_Slots(&cmt->gesture, &cmt->evstate, &tv);
+    }
+    cmt->evstate.rel_x = 0;
+}
+
+/*
+ * The same with Mouse Batch Frames, eight frames per read wakeup as from
+ * an 8 kHz mouse serviced at 1 kHz.
+ */
+static void
+Bench_Frame_RelMoveBatched(void* data, unsigned long iterations)
+{
+    BenchDevicePtr bd = data;
+    CmtDevicePtr cmt = &bd->cmt;
+    struct timeval tv = { 1, 0 };
+    unsigned long i;
+
+    cmt->props.mouse_batch_frames = TRUE;
+    for (i = 0; i < iterations; i++) {
+        cmt->evstate.rel_x = 1;
+        NextFrame(&tv);
+        Gesture_Process_Slots(&cmt->gesture, &cmt->evstate, &tv);
+        if (i % 8 == 7)
+            Gesture_Flush_Batch(&cmt->gesture);
+    }
+    Gesture_Flush_Batch(&cmt->gesture);
+    cmt->props.mouse_batch_frames = FALSE;
+    cmt->evstate.rel_x = 0;
+}
+
+/*
+ * Up to ten fingers down on a touchscreen, only the first one moving. All
+ * remaining slots are empty.
+ */
+static void
+Bench_Frame_OneMoving(void* data, unsigned long iterations)
+{
+    BenchDevicePtr bd = data;
+    CmtDevicePtr cmt = &bd->cmt;
+    EventStatePtr evstate = &cmt->evstate;
+    struct timeval tv = { 1, 0 };
+    unsigned long i;
+    int fingers = evstate->slot_count < 10 ? evstate->slot_count : 10;
+    int j;
+
+    for (j = 0; j < fingers; j++) {
+        evstate->slots[j].tracking_id = j + 1;
+        evstate->slots[j].position_x = 100 * j;
+        evstate->slots[j].position_y = 100 * j;
+        evstate->slots[j].pressure = 30;
+    }
+    for (i = 0; i < iterations; i++) {
+        evstate->slots[0].position_x = i & 0xff;
+        NextFrame(&tv);
+        Gesture_Process_Slots(&cmt->gesture, evstate, &tv);
+    }
+    for (j = 0; j < fingers; j++)
+        evstate->slots[j].tracking_id = -1;
+    NextFrame(&tv);
+    Gesture_Process_Slots(&cmt->gesture, evstate, &tv);
+}
+
+/* One gesture of a given type posted as X events. */
+static void
+Bench_Gesture_Ready(void* data, unsigned long iterations)
+{
+    BenchGesturePtr bg = data;
+    struct Gesture gesture = bg->gesture;
+    unsigned long i;
+
+    for (i = 0; i < iterations; i++) {
+        gesture.start_time += 0.001;
+        gesture.end_time += 0.001;
+        Gesture_Gesture_Ready(&bg->bd->cmt.gesture, &gesture);
+    }
+}
+
+static void
+Gesture_Ready_Bench(void)
+{
+    BenchGestureRec gestures[] = {
+        { "move", NULL, { .type = kGestureTypeMove,
+                          .details.move = { 1.0, 1.0, 1.0, 1.0 } } },
+        { "scroll", NULL, { .type = kGestureTypeScroll,
+                            .details.scroll = { 0.0, 5.0, 0.0, 5.0 } } },
+        { "buttons_change", NULL,
+          { .type = kGestureTypeButtonsChange,
+            .details.buttons = { GESTURES_BUTTON_LEFT,
+                                 GESTURES_BUTTON_LEFT } } },
+        { "fling", NULL, { .type = kGestureTypeFling,
+                           .details.fling = { 0.0, 100.0, 0.0, 100.0, 0 } } },
+        { "swipe", NULL, { .type = kGestureTypeSwipe,
+                           .details.swipe = { 5.0, 0.0, 5.0, 0.0 } } },
+        { "swipe_lift", NULL, { .type = kGestureTypeSwipeLift } },
+        { "pinch", NULL, { .type = kGestureTypePinch,
+                           .details.pinch = { 1.0, 1.0 } } },
+        { "metrics", NULL, { .type = kGestureTypeMetrics } },
+    };
+    BenchDevicePtr bd = Bench_Device_New(EvdevClassTouchpad, 2);
+    char name[64];
+    int i;
+
+    for (i = 0; i < sizeof(gestures) / sizeof(gestures[0]); i++) {
+        gestures[i].bd = bd;
+        snprintf(name, sizeof(name), "Gesture_Gesture_Ready/%s",
+                 gestures[i].name);
+        Bench_Run(name, Bench_Gesture_Ready, &gestures[i]);
+    }
+
+    /* Moves folded into the held back one, as within a busy frame */
+    bd->cmt.props.coalesce_gestures = TRUE;
+    Bench_Run("Gesture_Gesture_Ready/move_coalesced", Bench_Gesture_Ready,
+              &gestures[0]);
+    Gesture_Flush_Coalesced(&bd->cmt.gesture);
+    Bench_Device_Free(bd);
+}
+
+void
+Gesture_Bench(void)
+{
+    static const int slot_counts[] = { 2, 10, 60 };
+    BenchDevicePtr bd = Bench_Device_New(EvdevClassTouchpad, 2);
+    char name[64];
+    int i;
+
+    Bench_Run("Gesture_Process_Slots/touchpad/no_keys",
+              Bench_Frame_NoKeys, bd);
+    Bench_Run("Gesture_Process_Slots/touchpad/key_toggle",
+              Bench_Frame_KeyToggle, bd);
+    Bench_Device_Free(bd);
+
+    /* Every device class runs its own frame handler */
+    bd = Bench_Device_New(EvdevClassMouse, 0);
+    Bench_Run("Gesture_Process_Slots/mouse/rel_move", Bench_Frame_RelMove, bd);
+    Bench_Run("Gesture_Process_Slots/mouse/rel_move_batched",
+              Bench_Frame_RelMoveBatched, bd);
+    Bench_Device_Free(bd);
+
+    bd = Bench_Device_New(EvdevClassMultitouchMouse, 2);
+    Bench_Run("Gesture_Process_Slots/multitouch_mouse/rel_move",
+              Bench_Frame_RelMove, bd);
+    Bench_Run("Gesture_Process_Slots/multitouch_mouse/no_keys",
+              Bench_Frame_NoKeys, bd);
+    Bench_Device_Free(bd);
+
+    for (i = 0; i < sizeof(slot_counts) / sizeof(slot_counts[0]); i++) {
+        bd = Bench_Device_New(EvdevClassTouchscreen, slot_counts[i]);
+        snprintf(name, sizeof(name),
+                 "Gesture_Process_Slots/touchscreen/%d_slots/one_moving",
+                 slot_counts[i]);
+        Bench_Run(name, Bench_Frame_OneMoving, bd);
+
+        bd->cmt.props.raw_passthrough = TRUE;
+        snprintf(name, sizeof(name),
+                 "Gesture_Process_Slots/raw/%d_slots/one_moving",
+                 slot_counts[i]);
+        Bench_Run(name, Bench_Frame_OneMoving, bd);
+
+        bd->cmt.props.raw_touch_skip_unchanged = TRUE;
+        snprintf(name, sizeof(name),
+                 "Gesture_Process_Slots/raw/%d_slots/one_moving_skip",
+                 slot_counts[i]);
+        Bench_Run(name, Bench_Frame_OneMoving, bd);
+        Bench_Device_Free(bd);
+    }
+
+    Gesture_Ready_Bench();
+}
@@ -30,7 +30,6 @@ typedef enum PropType {
 } PropType;
 
 struct GesturesProp {
-    GesturesProp* next;
     Atom atom;
     PropType type;
     size_t count;
@@ -45,6 +44,27 @@ struct GesturesProp {
     void* handler_data;
     GesturesPropGetHandler get;
     GesturesPropSetHandler set;
+    BOOL read_only;
+    BOOL reset_on_write;      /* Any client write just calls the set handler */
+    BOOL set_unlocked;        /* Set handler takes the input lock itself */
+    void* pending;            /* Initial value not yet sent to the server */
+    GesturesProp* next_pending;  /* Publication order, while pending */
+    BOOL checksum_valid;      /* checksum matches the value in the server */
+    CARD32 checksum;
+    GesturesProp* next_free;  /* Arena free list link, while unused */
+};
+
+/*
+ * GesturesProp records are carved out of per-device slabs, so creating the
+ * hundreds of properties of a device costs a handful of allocations, and
+ * closing it releases them all at once.
+ */
+#define PROP_SLAB_SIZE 128
+
+struct PropSlab {
+    struct PropSlab* next;
+    size_t used;
+    GesturesProp props[PROP_SLAB_SIZE];
 };
 
 /* XIProperty callbacks */
@@ -54,14 +74,31 @@ static int PropertyDel(DeviceIntPtr, Atom);
 
 /* Property List management functions */
 static GesturesProp* PropList_Find(DeviceIntPtr, Atom);
-static void PropList_Insert(DeviceIntPtr, GesturesProp*);
+static int PropList_Insert(DeviceIntPtr, GesturesProp*);
 static void PropList_Remove(DeviceIntPtr, GesturesProp*);
 static void PropList_Free(DeviceIntPtr);
 
+/* Property arena functions */
+static GesturesProp* PropArena_Alloc(CmtDevicePtr);
+static void PropArena_Release(CmtDevicePtr, GesturesProp*);
+static void PropArena_Free(CmtDevicePtr);
+
 /* Property helper functions */
 static int PropChange(DeviceIntPtr, Atom, PropType, size_t, const void*);
+static int PropDefer(CmtDevicePtr, GesturesProp*, PropType, size_t,
+                     const void*);
+static void PropUndefer(CmtDevicePtr, GesturesProp*);
+static CARD32 PropChecksum(GesturesProp*);
 static GesturesProp* PropCreate(DeviceIntPtr, const char*, PropType, void*,
                                 size_t, const void*);
+static GesturesProp* PropCreate_Counter(DeviceIntPtr, const char*, int*,
+                                        size_t);
+static GesturesProp* PropCreate_Histogram(DeviceIntPtr, const char*, int*,
+                                          size_t, GesturesPropGetHandler,
+                                          GesturesPropSetHandler, void*);
+static GesturesPropBool PropGet_Latency(void*);
+static GesturesPropBool PropGet_PerfCounters(void*);
+static void PropSet_Latency(void*);
 
 /* Typed PropertySet Callback Handlers */
 static int PropSet_Int(DeviceIntPtr, GesturesProp*, XIPropertyValuePtr, BOOL);
@@ -116,6 +153,7 @@ PropertiesInit(DeviceIntPtr dev)
     CmtDevicePtr cmt = info->private;
     CmtPropertiesPtr props = &cmt->props;
     GesturesProp *dump_debug_log_prop;
+    GesturesProp *perf_counters_prop;
     GesturesPropBool bool_false = FALSE;
 
     cmt->handlers = XIRegisterPropertyHandler(dev, PropertySet, PropertyGet,
@@ -123,6 +161,15 @@ PropertiesInit(DeviceIntPtr dev)
     if (cmt->handlers == 0)
         return BadAlloc;
 
+    /*
+     * Until PropertiesPublish, property creation only records the initial
+     * values, so device init does not round trip through the XI property
+     * code once per property.
+     */
+    cmt->props_deferred = xf86SetBoolOption(info->options,
+                                            "Defer Property Publication",
+                                            TRUE);
+
     /* Create Device Properties */
 
     /* Read Only properties */
@@ -170,8 +217,18 @@ PropertiesInit(DeviceIntPtr dev)
                                           &props->dump_debug_log,
                                           1,
                                           &bool_false);
-    Prop_RegisterHandlers(dev, dump_debug_log_prop, &cmt->evdev, NULL,
-                          Event_Dump_Debug_Log);
+    Prop_RegisterHandlers(dev, dump_debug_log_prop, info, NULL,
+                          DebugLog_Dump);
+    /* Only the copy of the log is taken under the input lock */
+    if (dump_debug_log_prop)
+        dump_debug_log_prop->set_unlocked = TRUE;
+    PropCreate_Bool(dev,
+                    CMT_PROP_DUMP_DEBUG_LOG_ASYNC,
+                    &props->dump_debug_log_async,
+                    1,
+                    &bool_false);
+    PropCreate_Counter(dev, CMT_PROP_DUMP_DEBUG_LOG_STATUS, cmt->dump_stats,
+                       CMT_NUM_DUMP_STATS);
 
     PropCreate_Bool(dev,
                     CMT_PROP_RAW_TOUCH_PASSTHROUGH,
@@ -179,9 +236,115 @@ PropertiesInit(DeviceIntPtr dev)
                     1,
                     &bool_false);
 
+    /*
+     * In raw passthrough mode, optionally drop touch updates for slots whose
+     * position, pressure and touch major all moved by no more than the
+     * deadband since the last update posted for them.
+     */
+    PropCreate_Bool(dev,
+                    CMT_PROP_RAW_TOUCH_SKIP_UNCHANGED,
+                    &props->raw_touch_skip_unchanged,
+                    1,
+                    &bool_false);
+    PropCreate_IntSingle(dev, CMT_PROP_RAW_TOUCH_DEADBAND,
+                         &props->raw_touch_deadband, 0);
+    PropCreate_Counter(dev, CMT_PROP_RAW_TOUCH_SUPPRESSED,
+                       &props->raw_touch_suppressed, 1);
+
+    /*
+     * Optionally merge consecutive moves, or consecutive scrolls, generated
+     * for the same frame or timer tick into one event, posted at its end.
+     */
+    PropCreate_Bool(dev,
+                    CMT_PROP_COALESCE_GESTURES,
+                    &props->coalesce_gestures,
+                    1,
+                    &bool_false);
+    PropCreate_Counter(dev, CMT_PROP_GESTURES_COALESCED,
+                       &props->gestures_coalesced, 1);
+
+    /*
+     * Optionally merge the relative motion of all mouse frames read in one
+     * wakeup into a single hardware state. Button changes are pushed on
+     * their own.
+     */
+    PropCreate_Bool(dev,
+                    CMT_PROP_MOUSE_BATCH_FRAMES,
+                    &props->mouse_batch_frames,
+                    1,
+                    &bool_false);
+    PropCreate_Counter(dev, CMT_PROP_MOUSE_FRAMES_BATCHED,
+                       &props->mouse_frames_batched, 1);
+
+    /*
+     * Each ReadInput call drains the device until no complete frame is
+     * left, or until it has handled this many frames or spent this many
+     * microseconds. Zero or less disables the respective limit.
+     */
+    PropCreate_IntSingle(dev, CMT_PROP_READ_FRAME_BUDGET,
+                         &props->read_frame_budget, 256);
+    PropCreate_IntSingle(dev, CMT_PROP_READ_TIME_BUDGET,
+                         &props->read_time_budget, 2000);
+    PropCreate_Counter(dev, CMT_PROP_READ_STATS, cmt->read_stats,
+                       CMT_NUM_READ_STATS);
+
+    /* Gesture timer fires, mean and max lateness in microseconds */
+    PropCreate_Counter(dev, CMT_PROP_TIMER_LATENESS, cmt->gesture.timer_stats,
+                       CMT_NUM_TIMER_STATS);
+
+    /* Client reads that found the value already up to date in the server */
+    PropCreate_Counter(dev, CMT_PROP_PUSHES_SKIPPED,
+                       &props->prop_pushes_skipped, 1);
+
+    perf_counters_prop = PropCreate_Counter(dev, CMT_PROP_PERF_COUNTERS,
+                                            cmt->perf_counters,
+                                            CMT_NUM_PERF_COUNTERS);
+    Prop_RegisterHandlers(dev, perf_counters_prop, cmt, PropGet_PerfCounters,
+                          NULL);
+
+    /* Kernel timestamp to posted event latency, writing clears it */
+    PropCreate_Histogram(dev, CMT_PROP_INPUT_LATENCY, cmt->gesture.latency,
+                         CMT_NUM_LATENCY_STATS, PropGet_Latency,
+                         PropSet_Latency, &cmt->gesture);
+
     return Success;
 }
 
+/**
+ * Send the properties created since PropertiesInit to the server
+ */
+void
+PropertiesPublish(DeviceIntPtr dev)
+{
+    InputInfoPtr info = dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
+    GesturesProp* prop;
+
+    if (!cmt->props_deferred)
+        return;
+    cmt->props_deferred = FALSE;
+
+    /*
+     * In creation order, like properties created after this point. The
+     * server echoes each value back through PropertySet.
+     */
+    cmt->props_publishing = TRUE;
+    while ((prop = cmt->props_pending)) {
+        cmt->props_pending = prop->next_pending;
+        prop->next_pending = NULL;
+        if (PropChange(dev, prop->atom, prop->type, prop->count,
+                       prop->pending) == Success)
+            XISetDevicePropertyDeletable(dev, prop->atom, FALSE);
+        else
+            xf86IDrvMsg(info, X_ERROR, "Could not publish property \"%s\"\n",
+                        NameForAtom(prop->atom));
+        free(prop->pending);
+        prop->pending = NULL;
+    }
+    cmt->props_pending_tail = NULL;
+    cmt->props_publishing = FALSE;
+}
+
 /**
  * Cleanup Device Properties
  */
@@ -304,19 +467,37 @@ PropSet_Real(DeviceIntPtr dev, GesturesProp* prop, XIPropertyValuePtr val,
 
 /**
  * Device Property Handlers
+ *
+ * These run on the main thread. Set handlers reach into the gestures
+ * interpreter and get handlers read state owned by the input thread, so
+ * both hold the input lock. Set handlers marked set_unlocked are handed
+ * back through *unlocked and run by PropertySet once the lock is dropped.
  */
 static int
-PropertySet(DeviceIntPtr dev, Atom atom, XIPropertyValuePtr val,
-            BOOL checkonly)
+PropertySetLocked(DeviceIntPtr dev, Atom atom, XIPropertyValuePtr val,
+                  BOOL checkonly, GesturesProp** unlocked)
 {
+    InputInfoPtr info = dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
     GesturesProp* prop;
     int rc;
 
+    if (cmt->props_publishing)
+        return Success; /* Our own initial value, nothing to apply */
+
     prop = PropList_Find(dev, atom);
     if (!prop)
         return Success; /* Unknown or uninitialized Property */
 
-    if (prop->val.v == NULL)
+    if (prop->reset_on_write) {
+        if (!checkonly && prop->set)
+            prop->set(prop->handler_data);
+        /* The server now holds whatever the client wrote */
+        prop->checksum_valid = FALSE;
+        return Success;
+    }
+
+    if (prop->val.v == NULL || prop->read_only)
         return BadAccess; /* Read-only property */
 
     switch (prop->type) {
@@ -340,28 +521,75 @@ PropertySet(DeviceIntPtr dev, Atom atom, XIPropertyValuePtr val,
         break;
     }
 
-    if (!checkonly && rc == Success && prop->set)
-        prop->set(prop->handler_data);
+    if (!checkonly && rc == Success) {
+        /* The server now holds the value just written */
+        prop->checksum = PropChecksum(prop);
+        prop->checksum_valid = TRUE;
+        if (prop->set_unlocked)
+            *unlocked = prop;
+        else if (prop->set)
+            prop->set(prop->handler_data);
+    }
 
     return rc;
 }
 
 static int
-PropertyGet(DeviceIntPtr dev, Atom property)
+PropertySet(DeviceIntPtr dev, Atom atom, XIPropertyValuePtr val,
+            BOOL checkonly)
 {
+    GesturesProp* unlocked = NULL;
+    int rc;
+
+    input_lock();
+    rc = PropertySetLocked(dev, atom, val, checkonly, &unlocked);
+    input_unlock();
+    if (unlocked && unlocked->set)
+        unlocked->set(unlocked->handler_data);
+    return rc;
+}
+
+static int
+PropertyGetLocked(DeviceIntPtr dev, Atom property)
+{
+    InputInfoPtr info = dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
     GesturesProp* prop;
+    CARD32 checksum;
 
     prop = PropList_Find(dev, property);
     if (!prop)
         return Success; /* Unknown or uninitialized Property */
 
     // If get handler returns true, update the property value in the server.
-    if (prop->get && prop->get(prop->handler_data))
-        PropChange(dev, prop->atom, prop->type, prop->count, prop->val.v);
+    if (prop->get && prop->get(prop->handler_data)) {
+        /* Polling clients mostly read values that did not change */
+        checksum = PropChecksum(prop);
+        if (prop->checksum_valid && prop->checksum == checksum) {
+            cmt->props.prop_pushes_skipped++;
+            return Success;
+        }
+        if (PropChange(dev, prop->atom, prop->type, prop->count,
+                       prop->val.v) == Success) {
+            prop->checksum = checksum;
+            prop->checksum_valid = TRUE;
+        }
+    }
 
     return Success;
 }
 
+static int
+PropertyGet(DeviceIntPtr dev, Atom property)
+{
+    int rc;
+
+    input_lock();
+    rc = PropertyGetLocked(dev, property);
+    input_unlock();
+    return rc;
+}
+
 static int
 PropertyDel(DeviceIntPtr dev, Atom property)
 {
@@ -370,29 +598,90 @@ PropertyDel(DeviceIntPtr dev, Atom property)
 
 /**
  * Property List Management
+ *
+ * The gestures library registers hundreds of properties per device, so they
+ * are kept in an open addressing hash table keyed by atom, using linear
+ * probing. The table size is a power of two and is kept at most half full.
  */
 
+#define PROP_TABLE_MIN_SIZE 256
+
+static size_t
+PropList_Hash(Atom atom, size_t size)
+{
+    /*
+     * Atoms are small sequential integers, spread them by Fibonacci hashing:
+     * the top bits of the product are the well mixed ones.
+     */
+    return (CARD32)((CARD32)atom * 2654435761U) >> (32 - __builtin_ctzl(size));
+}
+
 static GesturesProp*
 PropList_Find(DeviceIntPtr dev, Atom atom)
 {
     InputInfoPtr info = dev->public.devicePrivate;
     CmtDevicePtr cmt = info->private;
+    size_t mask = cmt->prop_table_size - 1;
+    size_t i;
     GesturesProp* p;
 
-    for (p = cmt->prop_list; p && p->atom != atom; p = p->next)
-        continue;
+    if (!cmt->prop_table)
+        return NULL;
 
-    return p;
+    for (i = PropList_Hash(atom, cmt->prop_table_size);
+         (p = cmt->prop_table[i]); i = (i + 1) & mask)
+        if (p->atom == atom)
+            return p;
+
+    return NULL;
 }
 
 static void
+PropList_Place(GesturesProp** table, size_t size, GesturesProp* prop)
+{
+    size_t mask = size - 1;
+    size_t i;
+
+    for (i = PropList_Hash(prop->atom, size); table[i]; i = (i + 1) & mask)
+        continue;
+    table[i] = prop;
+}
+
+static int
+PropList_Grow(CmtDevicePtr cmt)
+{
+    size_t size = cmt->prop_table_size ? cmt->prop_table_size * 2 :
+                                         PROP_TABLE_MIN_SIZE;
+    GesturesProp** table;
+    size_t i;
+
+    table = calloc(size, sizeof(*table));
+    if (!table)
+        return BadAlloc;
+
+    for (i = 0; i < cmt->prop_table_size; i++)
+        if (cmt->prop_table[i])
+            PropList_Place(table, size, cmt->prop_table[i]);
+
+    free(cmt->prop_table);
+    cmt->prop_table = table;
+    cmt->prop_table_size = size;
+    return Success;
+}
+
+static int
 PropList_Insert(DeviceIntPtr dev, GesturesProp* prop)
 {
     InputInfoPtr info = dev->public.devicePrivate;
     CmtDevicePtr cmt = info->private;
 
-    prop->next = cmt->prop_list;
-    cmt->prop_list = prop;
+    if (2 * (cmt->prop_count + 1) > cmt->prop_table_size &&
+        PropList_Grow(cmt) != Success)
+        return BadAlloc;
+
+    PropList_Place(cmt->prop_table, cmt->prop_table_size, prop);
+    cmt->prop_count++;
+    return Success;
 }
 
 static void
@@ -400,21 +689,35 @@ PropList_Remove(DeviceIntPtr dev, GesturesProp* prop)
 {
     InputInfoPtr info = dev->public.devicePrivate;
     CmtDevicePtr cmt = info->private;
-    GesturesProp* p;
-
-    if (!cmt->prop_list || !prop)
-        return;
+    GesturesProp** table = cmt->prop_table;
+    size_t mask = cmt->prop_table_size - 1;
+    size_t i;
+    size_t j;
+    size_t home;
 
-    if (cmt->prop_list == prop) {
-        cmt->prop_list = prop->next;
+    if (!table || !prop)
         return;
-    }
 
-    for (p = cmt->prop_list; p->next; p = p->next)
-        if (p->next == prop) {
-            p->next = p->next->next;
+    for (i = PropList_Hash(prop->atom, cmt->prop_table_size);
+         table[i] != prop; i = (i + 1) & mask)
+        if (!table[i])
             return;
+
+    table[i] = NULL;
+    cmt->prop_count--;
+
+    /*
+     * Shift back the entries that follow in the probe sequence, so lookups
+     * never stop early at the slot we just emptied.
+     */
+    for (j = (i + 1) & mask; table[j]; j = (j + 1) & mask) {
+        home = PropList_Hash(table[j]->atom, cmt->prop_table_size);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            table[i] = table[j];
+            table[j] = NULL;
+            i = j;
         }
+    }
 }
 
 static void
@@ -422,9 +725,74 @@ PropList_Free(DeviceIntPtr dev)
 {
     InputInfoPtr info = dev->public.devicePrivate;
     CmtDevicePtr cmt = info->private;
+    size_t i;
+
+    /*
+     * The whole table goes away, so there is no need to unlink entries one
+     * by one; just drop the XI properties and release the arena.
+     */
+    for (i = 0; i < cmt->prop_table_size; i++)
+        if (cmt->prop_table[i]) {
+            DBG(info, "Freeing Property: \"%s\"\n",
+                NameForAtom(cmt->prop_table[i]->atom));
+            XIDeleteDeviceProperty(dev, cmt->prop_table[i]->atom, FALSE);
+            free(cmt->prop_table[i]->pending);
+        }
+
+    free(cmt->prop_table);
+    cmt->prop_table = NULL;
+    cmt->prop_table_size = 0;
+    cmt->prop_count = 0;
+    cmt->props_pending = NULL;
+    cmt->props_pending_tail = NULL;
+    PropArena_Free(cmt);
+}
+
+/**
+ * Property Arena
+ */
+static GesturesProp*
+PropArena_Alloc(CmtDevicePtr cmt)
+{
+    struct PropSlab* slab = cmt->prop_slabs;
+    GesturesProp* prop;
+
+    if (cmt->prop_free_list) {
+        prop = cmt->prop_free_list;
+        cmt->prop_free_list = prop->next_free;
+        memset(prop, 0, sizeof(*prop));
+        return prop;
+    }
+
+    if (!slab || slab->used == PROP_SLAB_SIZE) {
+        slab = calloc(1, sizeof(*slab));
+        if (!slab)
+            return NULL;
+        slab->next = cmt->prop_slabs;
+        cmt->prop_slabs = slab;
+    }
+
+    /* Slabs are calloc()ed and slots never handed out before are zeroed */
+    return &slab->props[slab->used++];
+}
+
+static void
+PropArena_Release(CmtDevicePtr cmt, GesturesProp* prop)
+{
+    prop->next_free = cmt->prop_free_list;
+    cmt->prop_free_list = prop;
+}
 
-    while (cmt->prop_list)
-        Prop_Free(dev, cmt->prop_list);
+static void
+PropArena_Free(CmtDevicePtr cmt)
+{
+    struct PropSlab* slab;
+
+    while ((slab = cmt->prop_slabs)) {
+        cmt->prop_slabs = slab->next;
+        free(slab);
+    }
+    cmt->prop_free_list = NULL;
 }
 
 static void
@@ -439,7 +807,8 @@ Prop_Free(void* priv, GesturesProp* prop)
     DBG(info, "Freeing Property: \"%s\"\n", NameForAtom(prop->atom));
     PropList_Remove(dev, prop);
     XIDeleteDeviceProperty(dev, prop->atom, FALSE);
-    free(prop);
+    PropUndefer(info->private, prop);
+    PropArena_Release(info->private, prop);
 }
 
 static int PropChange(DeviceIntPtr dev, Atom atom, PropType type, size_t count,
@@ -483,6 +852,123 @@ static int PropChange(DeviceIntPtr dev, Atom atom, PropType type, size_t count,
                                   PropModeReplace, size, val, FALSE);
 }
 
+/*
+ * Keep a copy of the initial value of a property until it is published.
+ * Properties are queued for publication in the order they were created.
+ */
+static int
+PropDefer(CmtDevicePtr cmt, GesturesProp* prop, PropType type, size_t count,
+          const void* val)
+{
+    size_t size;
+    void* pending;
+
+    switch (type) {
+    case PropTypeInt:
+        size = count * sizeof(CARD32);
+        break;
+    case PropTypeShort:
+        size = count * sizeof(CARD16);
+        break;
+    case PropTypeBool:
+        size = count * sizeof(CARD8);
+        break;
+    case PropTypeString:
+        size = strlen((const char*)val) + 1;
+        break;
+    case PropTypeReal:
+        size = count * sizeof(float);
+        break;
+    default: /* Unknown type */
+        return BadMatch;
+    }
+
+    pending = malloc(size ? size : 1);
+    if (!pending)
+        return BadAlloc;
+    memcpy(pending, val, size);
+
+    if (prop->pending) {
+        /* Created again, keeps its place in the queue */
+        free(prop->pending);
+    } else {
+        if (cmt->props_pending_tail)
+            cmt->props_pending_tail->next_pending = prop;
+        else
+            cmt->props_pending = prop;
+        cmt->props_pending_tail = prop;
+    }
+    prop->pending = pending;
+    return Success;
+}
+
+/*
+ * Drop the initial value of a property freed before it was published.
+ */
+static void
+PropUndefer(CmtDevicePtr cmt, GesturesProp* prop)
+{
+    GesturesProp** link;
+    GesturesProp* prev = NULL;
+
+    if (!prop->pending)
+        return;
+    free(prop->pending);
+    prop->pending = NULL;
+
+    for (link = &cmt->props_pending; *link; link = &(*link)->next_pending) {
+        if (*link == prop) {
+            *link = prop->next_pending;
+            if (cmt->props_pending_tail == prop)
+                cmt->props_pending_tail = prev;
+            prop->next_pending = NULL;
+            return;
+        }
+        prev = *link;
+    }
+}
+
+/*
+ * FNV-1a hash of the current value of a property, used to tell whether it
+ * changed since it was last sent to the server.
+ */
+static CARD32
+PropChecksum(GesturesProp* prop)
+{
+    const unsigned char* p = prop->val.v;
+    CARD32 hash = 2166136261U;
+    size_t size;
+    size_t i;
+
+    switch (prop->type) {
+    case PropTypeInt:
+        size = prop->count * sizeof(*prop->val.i);
+        break;
+    case PropTypeShort:
+        size = prop->count * sizeof(*prop->val.h);
+        break;
+    case PropTypeBool:
+        size = prop->count * sizeof(*prop->val.b);
+        break;
+    case PropTypeString:
+        p = p ? (const unsigned char*)*prop->val.s : NULL;
+        size = p ? strlen((const char*)p) : 0;
+        break;
+    case PropTypeReal:
+        size = prop->count * sizeof(*prop->val.r);
+        break;
+    default:
+        size = 0;
+        break;
+    }
+    if (!p)
+        size = 0;
+
+    for (i = 0; i < size; i++)
+        hash = (hash ^ p[i]) * 16777619U;
+    return hash;
+}
+
 /**
  * Device Property Creators
  */
@@ -491,6 +977,7 @@ PropCreate(DeviceIntPtr dev, const char* name, PropType type, void* val,
            size_t count, const void* init)
 {
     InputInfoPtr info = dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
     GesturesProp* prop;
     Atom atom;
 
@@ -500,23 +987,35 @@ PropCreate(DeviceIntPtr dev, const char* name, PropType type, void* val,
     if (atom == BAD_RESOURCE)
         return NULL;
 
-    if (PropChange(dev, atom, type, count, init) != Success)
-        return NULL;
-
-    XISetDevicePropertyDeletable(dev, atom, FALSE);
+    if (!cmt->props_deferred) {
+        if (PropChange(dev, atom, type, count, init) != Success)
+            return NULL;
+        XISetDevicePropertyDeletable(dev, atom, FALSE);
+    }
 
     prop = PropList_Find(dev, atom);
     if (!prop) {
-        prop = calloc(1, sizeof(*prop));
+        prop = PropArena_Alloc(cmt);
         if (!prop)
             return NULL;
-        PropList_Insert(dev, prop);
+        prop->atom = atom;
+        if (PropList_Insert(dev, prop) != Success) {
+            PropArena_Release(cmt, prop);
+            return NULL;
+        }
+    }
+
+    if (cmt->props_deferred &&
+        PropDefer(cmt, prop, type, count, init) != Success) {
+        Prop_Free(dev, prop);
+        return NULL;
     }
 
     prop->atom = atom;
     prop->type = type;
     prop->count = count;
     prop->val.v = val;
+    prop->checksum_valid = FALSE;
 
     return prop;
 }
@@ -614,6 +1113,75 @@ PropCreate_Real(void* priv, const char* name, double* val, size_t count,
     return PropCreate(dev, name, PropTypeReal, val, count, cfg);
 }
 
+/*
+ * Counters are read-only properties backed by driver memory. They are
+ * pushed to the server each time a client reads them.
+ */
+static GesturesPropBool
+PropGet_Counter(void* handler_data)
+{
+    return TRUE;
+}
+
+static GesturesProp*
+PropCreate_Counter(DeviceIntPtr dev, const char* name, int* val, size_t count)
+{
+    GesturesProp* prop;
+
+    prop = PropCreate(dev, name, PropTypeInt, val, count, val);
+    if (!prop)
+        return NULL;
+
+    prop->read_only = TRUE;
+    Prop_RegisterHandlers(dev, prop, NULL, PropGet_Counter, NULL);
+    return prop;
+}
+
+/*
+ * Histograms are counters that are cleared by writing any value to them.
+ */
+static GesturesProp*
+PropCreate_Histogram(DeviceIntPtr dev, const char* name, int* val,
+                     size_t count, GesturesPropGetHandler get,
+                     GesturesPropSetHandler reset, void* handler_data)
+{
+    GesturesProp* prop;
+
+    prop = PropCreate(dev, name, PropTypeInt, val, count, val);
+    if (!prop)
+        return NULL;
+
+    prop->reset_on_write = TRUE;
+    Prop_RegisterHandlers(dev, prop, handler_data, get, reset);
+    return prop;
+}
+
+static GesturesPropBool
+PropGet_PerfCounters(void* handler_data)
+{
+    CmtDevicePtr cmt = handler_data;
+
+    cmt->perf_counters[CMT_PERF_FRAMES] =
+        cmt->read_stats[CMT_READ_STAT_FRAMES];
+    cmt->perf_counters[CMT_PERF_READS] = cmt->read_stats[CMT_READ_STAT_READS];
+    cmt->perf_counters[CMT_PERF_TIMER_FIRES] =
+        cmt->gesture.timer_stats[CMT_TIMER_STAT_FIRES];
+    return TRUE;
+}
+
+static GesturesPropBool
+PropGet_Latency(void* handler_data)
+{
+    Gesture_Latency_Update(handler_data);
+    return TRUE;
+}
+
+static void
+PropSet_Latency(void* handler_data)
+{
+    Gesture_Latency_Reset(handler_data);
+}
+
 static void Prop_RegisterHandlers(void* priv, GesturesProp* prop,
                                   void* handler_data,
                                   GesturesPropGetHandler get,
@@ -24,10 +24,22 @@ typedef struct {
     int orientation_minimum;
     int orientation_maximum;
     int raw_passthrough;
+    GesturesPropBool raw_touch_skip_unchanged;
+    int raw_touch_deadband;
+    int raw_touch_suppressed;  /* Read-only counter */
+    GesturesPropBool coalesce_gestures;
+    int gestures_coalesced;  /* Read-only counter */
+    GesturesPropBool mouse_batch_frames;
+    int mouse_frames_batched;  /* Read-only counter */
+    int read_frame_budget;
+    int read_time_budget;
+    int prop_pushes_skipped;  /* Read-only counter */
     GesturesPropBool dump_debug_log;
+    GesturesPropBool dump_debug_log_async;
 } CmtProperties, *CmtPropertiesPtr;
 
 int PropertiesInit(DeviceIntPtr);
+void PropertiesPublish(DeviceIntPtr);
 void PropertiesClose(DeviceIntPtr);
 
 extern GesturesPropProvider prop_provider;
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xatom.h>
+
+typedef struct {
+    BenchDevicePtr bd;
+    Atom* atoms;
+    int natoms;
+} PropBenchRec, *PropBenchPtr;
+
+/* Look up properties through PropertyGet, like a client reading them. */
+static void
+Bench_Prop_Lookup(void* data, unsigned long iterations)
+{
+    PropBenchPtr pb = data;
+    unsigned long i;
+
+    for (i = 0; i < iterations; i++)
+        stub_property_get(&pb->bd->dev, pb->atoms[i % pb->natoms]);
+}
+
+/* Write an int property through PropertySet, like a client setting it. */
+static void
+Bench_Prop_Set(void* data, unsigned long iterations)
+{
+    PropBenchPtr pb = data;
+    CARD32 value = 256;
+    XIPropertyValueRec val;
+    unsigned long i;
+
+    memset(&val, 0, sizeof(val));
+    val.type = XA_INTEGER;
+    val.format = 32;
+    val.size = 1;
+    val.data = &value;
+    for (i = 0; i < iterations; i++) {
+        stub_property_set(&pb->bd->dev, pb->atoms[0], &val, TRUE);
+        stub_property_set(&pb->bd->dev, pb->atoms[0], &val, FALSE);
+    }
+}
+
+/* Bring a device up and down, like a hotplug cycle. */
+static void
+Bench_Prop_Hotplug(void* data, unsigned long iterations)
+{
+    unsigned long i;
+
+    for (i = 0; i < iterations; i++)
+        Bench_Device_Free(Bench_Device_New(EvdevClassTouchpad, 2));
+}
+
+/*
+ * Measure lookup cost against the number of properties on the device, on
+ * top of the ones the gestures library registers itself.
+ */
+void
+Properties_Bench(void)
+{
+    static const int extra_counts[] = { 0, 256, 1024, 4096 };
+    PropBenchRec pb;
+    char name[64];
+    int* vals;
+    int init = 0;
+    int i;
+    int j;
+
+    for (i = 0; i < sizeof(extra_counts) / sizeof(extra_counts[0]); i++) {
+        pb.bd = Bench_Device_New(EvdevClassTouchpad, 2);
+        pb.natoms = extra_counts[i] ? extra_counts[i] : 1;
+        pb.atoms = calloc(pb.natoms, sizeof(*pb.atoms));
+        vals = calloc(pb.natoms, sizeof(*vals));
+
+        pb.atoms[0] = MakeAtom(CMT_PROP_RAW_TOUCH_PASSTHROUGH,
+                               strlen(CMT_PROP_RAW_TOUCH_PASSTHROUGH), TRUE);
+        for (j = 0; j < extra_counts[i]; j++) {
+            snprintf(name, sizeof(name), "Bench Property %d", j);
+            prop_provider.create_int_fn(&pb.bd->dev, name, &vals[j], 1, &init);
+            pb.atoms[j] = MakeAtom(name, strlen(name), TRUE);
+        }
+
+        snprintf(name, sizeof(name), "PropList_Find/%d_extra_props",
+                 extra_counts[i]);
+        Bench_Run(name, Bench_Prop_Lookup, &pb);
+
+        Bench_Device_Free(pb.bd);
+        free(vals);
+        free(pb.atoms);
+    }
+
+    /* Polling a read-only counter that does not change */
+    pb.bd = Bench_Device_New(EvdevClassTouchpad, 2);
+    pb.natoms = 1;
+    pb.atoms = calloc(pb.natoms, sizeof(*pb.atoms));
+    pb.atoms[0] = MakeAtom(CMT_PROP_READ_STATS, strlen(CMT_PROP_READ_STATS),
+                           TRUE);
+    Bench_Run("PropertyGet/unchanged_counter", Bench_Prop_Lookup, &pb);
+
+    pb.atoms[0] = MakeAtom(CMT_PROP_READ_FRAME_BUDGET,
+                           strlen(CMT_PROP_READ_FRAME_BUDGET), TRUE);
+    Bench_Run("PropertySet/int", Bench_Prop_Set, &pb);
+    Bench_Device_Free(pb.bd);
+    free(pb.atoms);
+
+    Bench_Run("Properties/hotplug_cycle", Bench_Prop_Hotplug, NULL);
+}
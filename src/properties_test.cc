@@ -0,0 +1,204 @@
+// Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C" {
+#undef __cplusplus
+#define bool bool_
+#define class class_
+#define delete delete_
+#define new new_
+#define private private_
+#define public public_
+#include "cmt.h"
+#include "properties.h"
+#undef bool
+#undef class
+#undef delete
+#undef new
+#undef private
+#undef public
+#define __cplusplus 1
+
+extern int (*stub_property_set)(DeviceIntPtr dev, Atom property,
+                                XIPropertyValuePtr prop, BOOL checkonly);
+}
+
+// More than the initial table holds at half load, so it has to grow
+static const int kNumProps = 1000;
+
+// Atoms sent to the server, in order
+static std::vector<Atom> published;
+
+static int RecordPropertySet(DeviceIntPtr dev, Atom property,
+                             XIPropertyValuePtr prop, BOOL checkonly) {
+  if (!checkonly)
+    published.push_back(property);
+  return Success;
+}
+
+// Exercises the property hash table through the property provider and the
+// XI set handler, which looks properties up by atom.
+class PropertiesTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    memset(&dev_, 0, sizeof(dev_));
+    memset(&info_, 0, sizeof(info_));
+    memset(&cmt_, 0, sizeof(cmt_));
+    memset(props_, 0, sizeof(props_));
+    info_.private_ = &cmt_;
+    dev_.public_.devicePrivate = &info_;
+    cmt_.device = const_cast<char*>("/dev/input/event-test");
+    ASSERT_EQ(Success, PropertiesInit(&dev_));
+    PropertiesPublish(&dev_);
+  }
+
+  virtual void TearDown() {
+    PropertiesClose(&dev_);
+  }
+
+  static void Name(int i, char* name, size_t size) {
+    snprintf(name, size, "Test Property %d", i);
+  }
+
+  // Consecutive atoms never collide, so allocate a few unused atoms in
+  // between to make the atoms of the test properties sparse and irregular.
+  void SkipAtoms(int i) {
+    char name[32];
+
+    for (int j = (i * 7919) % 13; j > 0; j--) {
+      snprintf(name, sizeof(name), "Test Atom %d/%d", i, j);
+      MakeAtom(name, strlen(name), TRUE);
+    }
+  }
+
+  void Create(int i) {
+    char name[32];
+    int init = 0;
+
+    Name(i, name, sizeof(name));
+    SkipAtoms(i);
+    props_[i] = prop_provider.create_int_fn(&dev_, name, &vals_[i], 1, &init);
+    ASSERT_TRUE(props_[i] != NULL);
+  }
+
+  Atom AtomOf(int i) {
+    char name[32];
+
+    Name(i, name, sizeof(name));
+    return MakeAtom(name, strlen(name), FALSE);
+  }
+
+  void Free(int i) {
+    prop_provider.free_fn(&dev_, props_[i]);
+    props_[i] = NULL;
+  }
+
+  // Whether a client write to the property reaches its value, which it
+  // only does if the set handler finds the property by its atom.
+  bool Found(int i) {
+    CARD32 value = 1000 + i;
+    XIPropertyValueRec val;
+
+    val.type = XA_INTEGER;
+    val.format = 32;
+    val.size = 1;
+    val.data = &value;
+    vals_[i] = 0;
+    stub_property_set(&dev_, AtomOf(i), &val, FALSE);
+    return vals_[i] == 1000 + i;
+  }
+
+  DeviceIntRec dev_;
+  InputInfoRec info_;
+  CmtDeviceRec cmt_;
+  GesturesProp* props_[kNumProps];
+  int vals_[kNumProps];
+};
+
+TEST_F(PropertiesTest, InsertAndGrowTest) {
+  size_t initial_size = cmt_.prop_table_size;
+
+  for (int i = 0; i < kNumProps; i++)
+    Create(i);
+
+  EXPECT_GT(cmt_.prop_table_size, initial_size);
+  EXPECT_EQ(0u, cmt_.prop_table_size & (cmt_.prop_table_size - 1));
+  EXPECT_LE(2 * cmt_.prop_count, cmt_.prop_table_size);
+  for (int i = 0; i < kNumProps; i++)
+    EXPECT_TRUE(Found(i)) << "property " << i;
+}
+
+TEST_F(PropertiesTest, RemoveTest) {
+  size_t count;
+
+  for (int i = 0; i < kNumProps; i++)
+    Create(i);
+  count = cmt_.prop_count;
+
+  // Leave holes all over the probe sequences
+  for (int i = 0; i < kNumProps; i += 3)
+    Free(i);
+
+  EXPECT_EQ(count - (kNumProps + 2) / 3, cmt_.prop_count);
+  for (int i = 0; i < kNumProps; i++)
+    EXPECT_EQ(i % 3 != 0, Found(i)) << "property " << i;
+
+  for (int i = 0; i < kNumProps; i += 3)
+    Create(i);
+
+  EXPECT_EQ(count, cmt_.prop_count);
+  for (int i = 0; i < kNumProps; i++)
+    EXPECT_TRUE(Found(i)) << "property " << i;
+}
+
+TEST_F(PropertiesTest, RecreateTest) {
+  size_t count;
+
+  Create(0);
+  count = cmt_.prop_count;
+
+  // Creating an existing property updates it in place
+  Create(0);
+  EXPECT_EQ(count, cmt_.prop_count);
+  EXPECT_TRUE(Found(0));
+
+  Free(0);
+  EXPECT_EQ(count - 1, cmt_.prop_count);
+  EXPECT_FALSE(Found(0));
+}
+
+TEST_F(PropertiesTest, PublishOrderTest) {
+  int (*property_set)(DeviceIntPtr, Atom, XIPropertyValuePtr, BOOL) =
+      stub_property_set;
+  size_t n = 0;
+
+  // As between PropertiesInit and PropertiesPublish
+  cmt_.props_deferred = TRUE;
+  for (int i = 0; i < kNumProps; i++)
+    Create(i);
+  for (int i = 0; i < kNumProps; i += 3)
+    Free(i);
+
+  published.clear();
+  stub_property_set = RecordPropertySet;
+  PropertiesPublish(&dev_);
+  stub_property_set = property_set;
+
+  // Publication order is creation order, freed properties are not sent
+  ASSERT_EQ(static_cast<size_t>(kNumProps - (kNumProps + 2) / 3),
+            published.size());
+  for (int i = 0; i < kNumProps; i++)
+    if (i % 3 != 0)
+      EXPECT_EQ(AtomOf(i), published[n++]) << "property " << i;
+  for (int i = 0; i < kNumProps; i++)
+    if (i % 3 != 0)
+      EXPECT_TRUE(Found(i)) << "property " << i;
+}
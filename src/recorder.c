@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "recorder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cmt.h"
+
+#define RECORDER_DEFAULT_PATH "/var/log/xorg/cmt_flight_%s.dat"
+#define RECORDER_DEFAULT_RECORDS 16384
+
+/* Readers of the file rely on this layout */
+typedef char RecorderHeaderSize[sizeof(RecorderHeader) == 64 ? 1 : -1];
+typedef char RecorderRecordSize[sizeof(RecorderRecord) == 32 ? 1 : -1];
+
+/* Pressure and touch major are stored in 16 bits, see RecorderRecord */
+static int16_t
+Recorder_Clamp16(int value)
+{
+    if (value > INT16_MAX)
+        return INT16_MAX;
+    if (value < INT16_MIN)
+        return INT16_MIN;
+    return value;
+}
+
+static char*
+Recorder_DefaultPath(const char* device)
+{
+    const char* name = device ? strrchr(device, '/') : NULL;
+    size_t size;
+    char* path;
+
+    name = name ? name + 1 : (device ? device : "unknown");
+    size = strlen(RECORDER_DEFAULT_PATH) + strlen(name);
+    path = malloc(size);
+    if (path)
+        snprintf(path, size, RECORDER_DEFAULT_PATH, name);
+    return path;
+}
+
+void
+Recorder_Open(RecorderPtr rec, InputInfoPtr info, EvdevPtr evdev)
+{
+    CmtDevicePtr cmt = info->private;
+    EventStatePtr evstate = evdev->evstate;
+    char old_path[PATH_MAX];
+    char* default_path;
+    char* path;
+    int records;
+    int fd;
+    int i;
+
+    memset(rec, 0, sizeof(*rec));
+    if (!xf86SetBoolOption(info->options, "Flight Recorder", TRUE))
+        return;
+
+    records = xf86SetIntOption(info->options, "Flight Recorder Records",
+                               RECORDER_DEFAULT_RECORDS);
+    if (records <= 0)
+        return;
+
+    default_path = Recorder_DefaultPath(cmt->device);
+    path = xf86SetStrOption(info->options, "Flight Recorder File",
+                            default_path);
+    free(default_path);
+    if (!path)
+        return;
+
+    /* Keep the recording of the previous server around to be collected */
+    if (snprintf(old_path, sizeof(old_path), "%s.old", path) <
+            (int)sizeof(old_path))
+        rename(path, old_path);
+
+    rec->map_size = sizeof(RecorderHeader) +
+                    (size_t)records * sizeof(RecorderRecord);
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0 || fchmod(fd, 0600) < 0 ||
+        ftruncate(fd, rec->map_size) < 0) {
+        xf86IDrvMsg(info, X_WARNING, "Flight recorder disabled, %s: %s\n",
+                    path, strerror(errno));
+        goto Error;
+    }
+
+    rec->header = mmap(NULL, rec->map_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+    if (rec->header == MAP_FAILED) {
+        xf86IDrvMsg(info, X_WARNING, "Flight recorder disabled, %s: %s\n",
+                    path, strerror(errno));
+        rec->header = NULL;
+        goto Error;
+    }
+
+    rec->slot_count = evstate->slot_count;
+    if (rec->slot_count > 0) {
+        rec->prev_slots = calloc(rec->slot_count, sizeof(*rec->prev_slots));
+        if (!rec->prev_slots) {
+            munmap(rec->header, rec->map_size);
+            rec->header = NULL;
+            goto Error;
+        }
+        for (i = 0; i < rec->slot_count; i++)
+            rec->prev_slots[i].tracking_id = -1;
+    }
+
+    rec->ring = (RecorderRecord*)(rec->header + 1);
+    rec->count = records;
+    memcpy(rec->header->magic, CMT_REC_MAGIC, sizeof(rec->header->magic));
+    rec->header->version = CMT_REC_VERSION;
+    rec->header->record_size = sizeof(RecorderRecord);
+    rec->header->record_count = records;
+
+    xf86IDrvMsg(info, X_CONFIG, "Flight recorder: \"%s\", %d records\n",
+                path, records);
+
+Error:
+    if (fd >= 0)
+        close(fd);
+    free(path);
+}
+
+static RecorderRecord*
+Recorder_Next(RecorderPtr rec, CARD64 time, RecorderRecordType type,
+              int index)
+{
+    RecorderRecord* r = &rec->ring[rec->head];
+
+    if (++rec->head == rec->count)
+        rec->head = 0;
+    r->time = time;
+    r->seq = rec->seq;
+    r->type = type;
+    r->index = index;
+    return r;
+}
+
+/*
+ * Append one frame. Only slots and keys that changed since the previous
+ * frame are written, so an idle finger costs a compare per slot.
+ */
+void
+Recorder_Frame(RecorderPtr rec, EvdevPtr evdev, struct timeval* tv)
+{
+    EventStatePtr evstate = evdev->evstate;
+    CARD64 time;
+    RecorderRecord* r;
+    MtSlotPtr slot;
+    MtSlotPtr prev;
+    unsigned long changed;
+    int bit;
+    int i;
+
+    if (!rec->header)
+        return;
+
+    time = (CARD64)tv->tv_sec * 1000000 + tv->tv_usec;
+    rec->seq++;
+
+    r = Recorder_Next(rec, time, CMT_REC_FRAME, 0);
+    r->u.frame.rel_x = evstate->rel_x;
+    r->u.frame.rel_y = evstate->rel_y;
+    r->u.frame.rel_wheel = evstate->rel_wheel;
+    r->u.frame.rel_hwheel = evstate->rel_hwheel;
+
+    for (i = 0; i < rec->slot_count && i < evstate->slot_count; i++) {
+        slot = &evstate->slots[i];
+        prev = &rec->prev_slots[i];
+        if (slot->tracking_id == prev->tracking_id &&
+            slot->position_x == prev->position_x &&
+            slot->position_y == prev->position_y &&
+            slot->pressure == prev->pressure &&
+            slot->touch_major == prev->touch_major)
+            continue;
+        *prev = *slot;
+
+        r = Recorder_Next(rec, time, CMT_REC_SLOT, i);
+        r->u.slot.tracking_id = slot->tracking_id;
+        r->u.slot.position_x = slot->position_x;
+        r->u.slot.position_y = slot->position_y;
+        r->u.slot.pressure = Recorder_Clamp16(slot->pressure);
+        r->u.slot.touch_major = Recorder_Clamp16(slot->touch_major);
+    }
+
+    for (i = 0; i < CMT_REC_KEY_LONGS; i++) {
+        changed = evdev->key_state_bitmask[i] ^ rec->prev_keys[i];
+        if (!changed)
+            continue;
+        rec->prev_keys[i] = evdev->key_state_bitmask[i];
+        while (changed) {
+            bit = __builtin_ctzl(changed);
+            changed &= changed - 1;
+            r = Recorder_Next(rec, time, CMT_REC_KEY,
+                              i * CMT_REC_LONG_BITS + bit);
+            r->u.key.value = (rec->prev_keys[i] >> bit) & 1;
+        }
+    }
+
+    rec->header->head = rec->head;
+    rec->header->seq = rec->seq;
+}
+
+void
+Recorder_Close(RecorderPtr rec)
+{
+    if (rec->header)
+        munmap(rec->header, rec->map_size);
+    free(rec->prev_slots);
+    memset(rec, 0, sizeof(*rec));
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef _RECORDER_H_
+#define _RECORDER_H_
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#include <xorg-server.h>
+#include <xf86.h>
+#include <xf86Xinput.h>
+// todo(denniskempin): allow libevdev to be included before X headers
+#include <libevdev/libevdev.h>
+
+/*
+ * Flight recorder: every evdev frame is appended to a ring of fixed size
+ * records in a memory mapped file. The kernel keeps the pages of a shared
+ * mapping, so the last few minutes of input survive a server crash.
+ *
+ * The file is a RecorderHeader followed by the ring. Each frame writes one
+ * FRAME record, then one SLOT record per slot that changed and one KEY
+ * record per key that changed, all tagged with the frame's seq. The header
+ * head and seq are updated once the whole frame is written.
+ *
+ * To keep records at 32 bytes, slot pressure and touch major are stored in
+ * 16 bits. Larger values, which no known touchpad reports, are clamped.
+ * The file is created readable by its owner only, since it holds every key
+ * press.
+ */
+
+#define CMT_REC_MAGIC "CMTREC\0\0"
+#define CMT_REC_VERSION 1
+
+#define CMT_REC_LONG_BITS (sizeof(long) * 8)
+#define CMT_REC_KEY_LONGS \
+    ((KEY_CNT + CMT_REC_LONG_BITS - 1) / CMT_REC_LONG_BITS)
+
+typedef enum {
+    CMT_REC_FRAME = 1,
+    CMT_REC_SLOT,
+    CMT_REC_KEY
+} RecorderRecordType;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t record_count;
+    uint32_t head;        /* Index of the next record to be written */
+    uint32_t seq;         /* Last frame fully written */
+    uint32_t reserved[9];
+} RecorderHeader;
+
+typedef struct {
+    uint64_t time;        /* Frame timestamp in microseconds */
+    uint32_t seq;         /* Frame number, starting at 1 */
+    uint8_t type;         /* RecorderRecordType */
+    uint8_t reserved;
+    uint16_t index;       /* Slot number or key code */
+    union {
+        struct {
+            int32_t rel_x;
+            int32_t rel_y;
+            int32_t rel_wheel;
+            int32_t rel_hwheel;
+        } frame;
+        struct {
+            int32_t tracking_id;
+            int32_t position_x;
+            int32_t position_y;
+            int16_t pressure;     /* Clamped to the int16_t range */
+            int16_t touch_major;  /* Clamped to the int16_t range */
+        } slot;
+        struct {
+            int32_t value;
+            uint32_t reserved[3];
+        } key;
+    } u;
+} RecorderRecord;
+
+typedef struct {
+    RecorderHeader* header;   /* NULL while not recording */
+    RecorderRecord* ring;
+    size_t map_size;
+    CARD32 count;
+    CARD32 head;
+    CARD32 seq;
+    MtSlotPtr prev_slots;     /* Slots as of the last recorded frame */
+    int slot_count;
+    unsigned long prev_keys[CMT_REC_KEY_LONGS];
+} RecorderRec, *RecorderPtr;
+
+void Recorder_Open(RecorderPtr, InputInfoPtr, EvdevPtr);
+void Recorder_Frame(RecorderPtr, EvdevPtr, struct timeval*);
+void Recorder_Close(RecorderPtr);
+
+#endif
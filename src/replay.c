@@ -0,0 +1,640 @@
+/*
+ * Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * cmt-replay: feed a recording through Gesture_Process_Slots and the real
+ * gestures interpreter, against the X entry points stubbed in test_stubs.c,
+ * as fast as possible. Prints the events the driver posts and the time each
+ * frame took to process.
+ *
+ *   cmt-replay [-q] [-d device.desc] recording
+ *
+ * The recording is either evemu-record output, or a flight recorder file
+ * (see recorder.h) together with the evemu-describe output of the device
+ * given with -d. Only multitouch protocol B and relative devices are
+ * supported.
+ *
+ * Time is virtual: every clock the driver and the gestures library read
+ * returns the timestamp of the frame being replayed, and gesture timers
+ * fire in between frames when they come due.
+ */
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cmt.h"
+#include "recorder.h"
+
+/* How long to keep firing gesture timers after the last frame */
+#define REPLAY_DRAIN_US 5000000ULL
+
+/* test_stubs.c */
+extern FILE* stub_event_output;
+OsTimerPtr stub_timer_next(CARD32* expires);
+void stub_timer_run(OsTimerPtr timer, CARD32 now);
+
+typedef struct {
+    InputInfoRec info;
+    DeviceIntRec dev;
+    CmtDeviceRec cmt;
+    size_t desc_offsets[EV_CNT];  /* Next byte of each B: bitmask */
+    size_t desc_prop_offset;      /* Next byte of the P: bitmask */
+    unsigned long frames;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+} ReplayRec, *ReplayPtr;
+
+/**
+ * Virtual clock
+ */
+static Bool replay_clock_virtual;
+static CARD64 replay_now_us;
+
+int
+clock_gettime(clockid_t clk, struct timespec* ts)
+{
+    static int (*real_clock_gettime)(clockid_t, struct timespec*);
+
+    if (!replay_clock_virtual) {
+        if (!real_clock_gettime)
+            real_clock_gettime = dlsym(RTLD_NEXT, "clock_gettime");
+        return real_clock_gettime(clk, ts);
+    }
+    ts->tv_sec = replay_now_us / 1000000;
+    ts->tv_nsec = (replay_now_us % 1000000) * 1000;
+    return 0;
+}
+
+int
+gettimeofday(struct timeval* tv, void* tz)
+{
+    static int (*real_gettimeofday)(struct timeval*, void*);
+
+    if (!replay_clock_virtual) {
+        if (!real_gettimeofday)
+            real_gettimeofday = dlsym(RTLD_NEXT, "gettimeofday");
+        return real_gettimeofday(tv, tz);
+    }
+    tv->tv_sec = replay_now_us / 1000000;
+    tv->tv_usec = replay_now_us % 1000000;
+    return 0;
+}
+
+static unsigned long long
+Replay_WallNs(void)
+{
+    struct timespec ts;
+
+    replay_clock_virtual = FALSE;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    replay_clock_virtual = TRUE;
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Fire the gesture timers that are due by the given time, advancing the
+ * virtual clock to each of them in turn.
+ */
+static void
+Replay_RunTimers(CARD64 until_us)
+{
+    OsTimerPtr timer;
+    CARD32 expires;
+
+    while ((timer = stub_timer_next(&expires)) &&
+           (CARD64)expires * 1000 <= until_us) {
+        if ((CARD64)expires * 1000 > replay_now_us)
+            replay_now_us = (CARD64)expires * 1000;
+        stub_timer_run(timer, expires);
+    }
+    if (until_us > replay_now_us)
+        replay_now_us = until_us;
+}
+
+static void
+Replay_Frame(ReplayPtr rp, struct timeval* tv)
+{
+    EventStatePtr evstate = &rp->cmt.evstate;
+    unsigned long long start;
+    unsigned long long ns;
+
+    Replay_RunTimers((CARD64)tv->tv_sec * 1000000 + tv->tv_usec);
+
+    start = Replay_WallNs();
+    Gesture_Process_Slots(&rp->cmt.gesture, evstate, tv);
+    /* Each frame stands for one wakeup, which ends like ReadInput's */
+    Gesture_Flush_Batch(&rp->cmt.gesture);
+    ns = Replay_WallNs() - start;
+
+    rp->frames++;
+    rp->total_ns += ns;
+    if (ns > rp->max_ns)
+        rp->max_ns = ns;
+    if (stub_event_output)
+        fprintf(stub_event_output, "frame %lu %ld.%06ld %llu ns\n",
+                rp->frames, (long)tv->tv_sec, (long)tv->tv_usec, ns);
+
+    evstate->rel_x = 0;
+    evstate->rel_y = 0;
+    evstate->rel_wheel = 0;
+    evstate->rel_hwheel = 0;
+}
+
+/**
+ * Device description, in evemu-describe format
+ */
+static void
+Replay_SetBits(unsigned long* bits, size_t size, size_t byte, unsigned value)
+{
+    size_t bit;
+
+    for (bit = 0; bit < 8; bit++) {
+        if (!(value & (1U << bit)))
+            continue;
+        if ((byte * 8 + bit) / LONG_BITS >= size / sizeof(*bits))
+            return;
+        bits[(byte * 8 + bit) / LONG_BITS] |= 1UL << ((byte * 8 + bit) %
+                                                      LONG_BITS);
+    }
+}
+
+static int
+Replay_TestBit(const unsigned long* bits, int bit)
+{
+    return !!(bits[bit / LONG_BITS] & (1UL << (bit % LONG_BITS)));
+}
+
+static void
+Replay_SetBitList(unsigned long* bits, size_t size, size_t* offset,
+                  const char* list)
+{
+    unsigned value;
+    int n;
+
+    while (sscanf(list, "%x%n", &value, &n) == 1) {
+        Replay_SetBits(bits, size, (*offset)++, value);
+        list += n;
+    }
+}
+
+/* Returns TRUE if the line was part of the device description */
+static Bool
+Replay_ParseDescription(ReplayPtr rp, const char* line)
+{
+    EvdevInfoPtr info = &rp->cmt.evdev.info;
+    size_t* offsets = rp->desc_offsets;
+    unsigned bustype, vendor, product, version;
+    int code, min, max, fuzz, flat, res;
+    unsigned type;
+    int n;
+
+    if (!strncmp(line, "N: ", 3)) {
+        snprintf(info->name, sizeof(info->name), "%.*s",
+                 (int)strcspn(line + 3, "\n"), line + 3);
+    } else if (sscanf(line, "I: %x %x %x %x", &bustype, &vendor, &product,
+                      &version) == 4) {
+        info->id.bustype = bustype;
+        info->id.vendor = vendor;
+        info->id.product = product;
+        info->id.version = version;
+    } else if (!strncmp(line, "P: ", 3)) {
+        Replay_SetBitList(info->prop_bitmask, sizeof(info->prop_bitmask),
+                          &rp->desc_prop_offset, line + 3);
+    } else if (sscanf(line, "B: %x%n", &type, &n) == 1) {
+        if (type >= EV_CNT)
+            return TRUE;
+        switch (type) {
+        case EV_SYN:
+            Replay_SetBitList(info->bitmask, sizeof(info->bitmask),
+                              &offsets[type], line + n);
+            break;
+        case EV_KEY:
+            Replay_SetBitList(info->key_bitmask, sizeof(info->key_bitmask),
+                              &offsets[type], line + n);
+            break;
+        case EV_REL:
+            Replay_SetBitList(info->rel_bitmask, sizeof(info->rel_bitmask),
+                              &offsets[type], line + n);
+            break;
+        case EV_ABS:
+            Replay_SetBitList(info->abs_bitmask, sizeof(info->abs_bitmask),
+                              &offsets[type], line + n);
+            break;
+        }
+    } else if ((n = sscanf(line, "A: %x %d %d %d %d %d", &code, &min, &max,
+                           &fuzz, &flat, &res)) >= 5) {
+        if (code < 0 || code >= ABS_CNT)
+            return TRUE;
+        info->absinfo[code].minimum = min;
+        info->absinfo[code].maximum = max;
+        info->absinfo[code].fuzz = fuzz;
+        info->absinfo[code].flat = flat;
+        info->absinfo[code].resolution = n == 6 ? res : 0;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static EvdevClass
+Replay_Class(EvdevInfoPtr info)
+{
+    Bool rel = Replay_TestBit(info->rel_bitmask, REL_X);
+    Bool mt = Replay_TestBit(info->abs_bitmask, ABS_MT_POSITION_X);
+
+    if (Replay_TestBit(info->prop_bitmask, INPUT_PROP_DIRECT) && mt)
+        return EvdevClassTouchscreen;
+    if (rel)
+        return mt ? EvdevClassMultitouchMouse : EvdevClassMouse;
+    if (mt)
+        return EvdevClassTouchpad;
+    return EvdevClassUnknown;
+}
+
+static void
+Replay_ResetDescription(ReplayPtr rp)
+{
+    memset(&rp->cmt.evdev.info, 0, sizeof(rp->cmt.evdev.info));
+    memset(rp->desc_offsets, 0, sizeof(rp->desc_offsets));
+    rp->desc_prop_offset = 0;
+}
+
+static int
+Replay_ReadDescription(ReplayPtr rp, const char* path)
+{
+    char line[1024];
+    FILE* fp;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    Replay_ResetDescription(rp);
+    while (fgets(line, sizeof(line), fp))
+        Replay_ParseDescription(rp, line);
+    fclose(fp);
+    return 0;
+}
+
+/**
+ * Fake device, set up the way DeviceInit and DeviceOn would
+ */
+static int
+Replay_DeviceStart(ReplayPtr rp, const char* name)
+{
+    CmtDevicePtr cmt = &rp->cmt;
+    EvdevInfoPtr info = &cmt->evdev.info;
+    int slot_count = 1;
+    int i;
+
+    info->evdev_class = Replay_Class(info);
+    info->is_monotonic = TRUE;
+    if (info->evdev_class == EvdevClassUnknown) {
+        fprintf(stderr, "Unsupported device, no device description?\n");
+        return -1;
+    }
+    if (Replay_TestBit(info->abs_bitmask, ABS_MT_SLOT))
+        slot_count = info->absinfo[ABS_MT_SLOT].maximum -
+                     info->absinfo[ABS_MT_SLOT].minimum + 1;
+
+    rp->info.private = cmt;
+    rp->info.fd = -1;
+    rp->info.name = (char*)name;
+    rp->dev.public.devicePrivate = &rp->info;
+
+    cmt->device = (char*)name;
+    cmt->evdev.fd = -1;
+    cmt->evdev.evstate = &cmt->evstate;
+    cmt->evstate.slot_min = info->absinfo[ABS_MT_SLOT].minimum;
+    cmt->evstate.slot_count = slot_count;
+    cmt->evstate.slots = calloc(slot_count, sizeof(*cmt->evstate.slots));
+    if (!cmt->evstate.slots)
+        return -1;
+    for (i = 0; i < slot_count; i++)
+        cmt->evstate.slots[i].tracking_id = -1;
+    cmt->evstate.slot_current = cmt->evstate.slots;
+
+    if (Gesture_Init(&cmt->gesture) != Success)
+        return -1;
+    if (PropertiesInit(&rp->dev) != Success)
+        return -1;
+    Gesture_Device_Init(&cmt->gesture, &rp->dev);
+    /* Virtual time drives the server timer list stubs, not timerfds */
+    cmt->gesture.hires_timers = FALSE;
+    PropertiesPublish(&rp->dev);
+    Gesture_Device_On(&cmt->gesture);
+    return 0;
+}
+
+static void
+Replay_DeviceStop(ReplayPtr rp)
+{
+    Replay_RunTimers(replay_now_us + REPLAY_DRAIN_US);
+    Gesture_Device_Off(&rp->cmt.gesture);
+    Gesture_Device_Close(&rp->cmt.gesture);
+    PropertiesClose(&rp->dev);
+    Gesture_Free(&rp->cmt.gesture);
+    free(rp->cmt.evstate.slots);
+}
+
+/**
+ * evemu-record recordings
+ */
+static void
+Replay_Event(ReplayPtr rp, struct input_event* ev)
+{
+    CmtDevicePtr cmt = &rp->cmt;
+    EventStatePtr evstate = &cmt->evstate;
+    MtSlotPtr slot;
+    int index;
+
+    switch (ev->type) {
+    case EV_SYN:
+        if (ev->code == SYN_REPORT)
+            Replay_Frame(rp, &ev->time);
+        break;
+    case EV_KEY:
+        if (ev->code >= KEY_CNT)
+            break;
+        if (ev->value)
+            cmt->evdev.key_state_bitmask[ev->code / LONG_BITS] |=
+                1UL << (ev->code % LONG_BITS);
+        else
+            cmt->evdev.key_state_bitmask[ev->code / LONG_BITS] &=
+                ~(1UL << (ev->code % LONG_BITS));
+        break;
+    case EV_REL:
+        if (ev->code == REL_X)
+            evstate->rel_x += ev->value;
+        else if (ev->code == REL_Y)
+            evstate->rel_y += ev->value;
+        else if (ev->code == REL_WHEEL)
+            evstate->rel_wheel += ev->value;
+        else if (ev->code == REL_HWHEEL)
+            evstate->rel_hwheel += ev->value;
+        break;
+    case EV_ABS:
+        if (ev->code == ABS_MT_SLOT) {
+            index = ev->value - evstate->slot_min;
+            if (index >= 0 && index < evstate->slot_count)
+                evstate->slot_current = &evstate->slots[index];
+            break;
+        }
+        slot = evstate->slot_current;
+        switch (ev->code) {
+        case ABS_MT_TRACKING_ID: slot->tracking_id = ev->value; break;
+        case ABS_MT_POSITION_X: slot->position_x = ev->value; break;
+        case ABS_MT_POSITION_Y: slot->position_y = ev->value; break;
+        case ABS_MT_PRESSURE: slot->pressure = ev->value; break;
+        case ABS_MT_TOUCH_MAJOR: slot->touch_major = ev->value; break;
+        case ABS_MT_TOUCH_MINOR: slot->touch_minor = ev->value; break;
+        case ABS_MT_WIDTH_MAJOR: slot->width_major = ev->value; break;
+        case ABS_MT_WIDTH_MINOR: slot->width_minor = ev->value; break;
+        case ABS_MT_ORIENTATION: slot->orientation = ev->value; break;
+        case ABS_MT_TOOL_TYPE: slot->tool_type = ev->value; break;
+        case ABS_MT_DISTANCE: slot->distance = ev->value; break;
+        }
+        break;
+    }
+}
+
+static int
+Replay_Evemu(ReplayPtr rp, const char* path)
+{
+    struct input_event ev;
+    char line[1024];
+    long sec;
+    long usec;
+    unsigned type;
+    unsigned code;
+    int value;
+    Bool started = FALSE;
+    Bool described = FALSE;
+    FILE* fp;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#')
+            continue;
+        if (!started && strchr("NIPBA", line[0]) && line[1] == ':') {
+            /* A recording with its own description replaces -d */
+            if (!described) {
+                Replay_ResetDescription(rp);
+                described = TRUE;
+            }
+            if (Replay_ParseDescription(rp, line))
+                continue;
+        }
+        if (sscanf(line, "E: %ld.%ld %x %x %d", &sec, &usec, &type, &code,
+                   &value) != 5)
+            continue;
+        if (!started) {
+            if (Replay_DeviceStart(rp, path) < 0)
+                goto Error;
+            started = TRUE;
+        }
+        memset(&ev, 0, sizeof(ev));
+        ev.time.tv_sec = sec;
+        ev.time.tv_usec = usec;
+        ev.type = type;
+        ev.code = code;
+        ev.value = value;
+        Replay_Event(rp, &ev);
+    }
+
+    fclose(fp);
+    if (started)
+        Replay_DeviceStop(rp);
+    return 0;
+
+Error:
+    fclose(fp);
+    return -1;
+}
+
+/**
+ * Flight recorder files
+ */
+static void
+Replay_Record(ReplayPtr rp, RecorderRecord* r, struct timeval* tv,
+              Bool* pending)
+{
+    CmtDevicePtr cmt = &rp->cmt;
+    EventStatePtr evstate = &cmt->evstate;
+    MtSlotPtr slot;
+
+    switch (r->type) {
+    case CMT_REC_FRAME:
+        if (*pending)
+            Replay_Frame(rp, tv);
+        *pending = TRUE;
+        tv->tv_sec = r->time / 1000000;
+        tv->tv_usec = r->time % 1000000;
+        evstate->rel_x = r->u.frame.rel_x;
+        evstate->rel_y = r->u.frame.rel_y;
+        evstate->rel_wheel = r->u.frame.rel_wheel;
+        evstate->rel_hwheel = r->u.frame.rel_hwheel;
+        break;
+    case CMT_REC_SLOT:
+        if (r->index >= evstate->slot_count)
+            break;
+        slot = &evstate->slots[r->index];
+        slot->tracking_id = r->u.slot.tracking_id;
+        slot->position_x = r->u.slot.position_x;
+        slot->position_y = r->u.slot.position_y;
+        slot->pressure = r->u.slot.pressure;
+        slot->touch_major = r->u.slot.touch_major;
+        break;
+    case CMT_REC_KEY:
+        if (r->index >= KEY_CNT)
+            break;
+        if (r->u.key.value)
+            cmt->evdev.key_state_bitmask[r->index / LONG_BITS] |=
+                1UL << (r->index % LONG_BITS);
+        else
+            cmt->evdev.key_state_bitmask[r->index / LONG_BITS] &=
+                ~(1UL << (r->index % LONG_BITS));
+        break;
+    }
+}
+
+static int
+Replay_Recorder(ReplayPtr rp, const char* path)
+{
+    RecorderHeader header;
+    RecorderRecord* ring = NULL;
+    RecorderRecord* r;
+    struct timeval tv = { 0, 0 };
+    Bool pending = FALSE;
+    Bool in_frame = FALSE;
+    CARD32 i;
+    FILE* fp;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, CMT_REC_MAGIC, sizeof(header.magic)) ||
+        header.version != CMT_REC_VERSION ||
+        header.record_size != sizeof(RecorderRecord) ||
+        header.head >= header.record_count) {
+        fprintf(stderr, "%s: not a flight recorder file\n", path);
+        goto Error;
+    }
+
+    ring = calloc(header.record_count, sizeof(*ring));
+    if (!ring ||
+        fread(ring, sizeof(*ring), header.record_count, fp) !=
+            header.record_count) {
+        fprintf(stderr, "%s: truncated\n", path);
+        goto Error;
+    }
+
+    if (Replay_DeviceStart(rp, path) < 0)
+        goto Error;
+
+    /* Oldest record first; drop a frame cut short by the wrap or a crash */
+    for (i = 0; i < header.record_count; i++) {
+        r = &ring[(header.head + i) % header.record_count];
+        if (r->seq == 0 || r->seq > header.seq)
+            continue;
+        if (r->type == CMT_REC_FRAME)
+            in_frame = TRUE;
+        if (in_frame)
+            Replay_Record(rp, r, &tv, &pending);
+    }
+    if (pending)
+        Replay_Frame(rp, &tv);
+
+    Replay_DeviceStop(rp);
+    free(ring);
+    fclose(fp);
+    return 0;
+
+Error:
+    free(ring);
+    fclose(fp);
+    return -1;
+}
+
+static void
+Replay_Usage(const char* argv0)
+{
+    fprintf(stderr, "usage: %s [-q] [-d device.desc] recording\n"
+            "  -q  only print the timing summary\n"
+            "  -d  evemu-describe output, for flight recorder files\n",
+            argv0);
+}
+
+int
+main(int argc, char** argv)
+{
+    static ReplayRec rp;
+    const char* desc = NULL;
+    char magic[8];
+    FILE* fp;
+    int rc;
+    int c;
+
+    stub_event_output = stdout;
+    while ((c = getopt(argc, argv, "qd:h")) != -1) {
+        switch (c) {
+        case 'q':
+            stub_event_output = NULL;
+            break;
+        case 'd':
+            desc = optarg;
+            break;
+        default:
+            Replay_Usage(argv[0]);
+            return c == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1) {
+        Replay_Usage(argv[0]);
+        return 2;
+    }
+
+    if (desc && Replay_ReadDescription(&rp, desc) < 0)
+        return 1;
+
+    fp = fopen(argv[optind], "rb");
+    if (!fp) {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+    c = fread(magic, 1, sizeof(magic), fp);
+    fclose(fp);
+
+    replay_clock_virtual = TRUE;
+    if (c == sizeof(magic) && !memcmp(magic, CMT_REC_MAGIC, sizeof(magic)))
+        rc = Replay_Recorder(&rp, argv[optind]);
+    else
+        rc = Replay_Evemu(&rp, argv[optind]);
+    if (rc < 0)
+        return 1;
+
+    fprintf(stderr, "%lu frames, %.1f us mean, %.1f us max per frame\n",
+            rp.frames,
+            rp.frames ? rp.total_ns / 1000.0 / rp.frames : 0.0,
+            rp.max_ns / 1000.0);
+    return 0;
+}
@@ -3,12 +3,23 @@
 // found in the LICENSE file.
 
 #include <linux/input.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include <xf86.h>
 #include <xf86Xinput.h>
+#include <xkbsrv.h>
 
 // Provide these symbols for unittests
 
+CARD64 GetTimeInMicros(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (CARD64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 int GetMotionHistorySize(void) {
   return 0;
 }
@@ -24,22 +35,115 @@ Bool InitPointerDeviceStruct(DevicePtr device,
   return 0;
 }
 
+Bool InitKeyboardDeviceStruct(DeviceIntPtr dev, XkbRMLVOSet* rmlvo,
+                              BellProcPtr bell_func,
+                              KbdCtrlProcPtr ctrl_func) {
+  return 0;
+}
+
+Bool InitTouchClassDeviceStruct(DeviceIntPtr device, unsigned int max_touches,
+                                unsigned int mode, unsigned int numAxes) {
+  return 0;
+}
+
+// Atoms are interned so each property name gets its own atom; atom N
+// names atom_names[N - 1].
+static char** atom_names;
+static Atom atom_count;
+
 Atom MakeAtom(const char* string,
               unsigned len,
               Bool makeit) {
-  return 0;
+  char** names;
+  Atom i;
+
+  for (i = 0; i < atom_count; i++)
+    if (strlen(atom_names[i]) == len && !strncmp(atom_names[i], string, len))
+      return i + 1;
+  if (!makeit)
+    return 0;
+  names = realloc(atom_names, (atom_count + 1) * sizeof(*atom_names));
+  if (!names)
+    return 0;
+  atom_names = names;
+  atom_names[atom_count] = strndup(string, len);
+  return ++atom_count;
 }
 
 const char* NameForAtom(Atom atom) {
-  return "";
+  if (atom == 0 || atom > atom_count)
+    return "";
+  return atom_names[atom - 1];
+}
+
+// When set, the xf86Post*M stubs print the events they are given here.
+FILE* stub_event_output = NULL;
+
+typedef struct {
+  double valuators[MAX_VALUATORS];
+  unsigned char set[MAX_VALUATORS];
+} StubValuatorMask;
+
+static void stub_print_mask(const ValuatorMask* vmask) {
+  const StubValuatorMask* mask = (const StubValuatorMask*)vmask;
+  int i;
+
+  for (i = 0; mask && i < MAX_VALUATORS; i++)
+    if (mask->set[i])
+      fprintf(stub_event_output, " v%d=%g", i, mask->valuators[i]);
+  fputc('\n', stub_event_output);
+}
+
+ValuatorMask* valuator_mask_new(int num_valuators) {
+  return (ValuatorMask*)calloc(1, sizeof(StubValuatorMask));
+}
+
+void valuator_mask_free(ValuatorMask** mask) {
+  free(*mask);
+  *mask = NULL;
 }
 
+void valuator_mask_set(ValuatorMask* mask, int valuator, int data) {
+  ((StubValuatorMask*)mask)->valuators[valuator] = data;
+  ((StubValuatorMask*)mask)->set[valuator] = 1;
+}
+
+void valuator_mask_set_double(ValuatorMask* mask, int valuator, double data) {
+  ((StubValuatorMask*)mask)->valuators[valuator] = data;
+  ((StubValuatorMask*)mask)->set[valuator] = 1;
+}
+
+void valuator_mask_zero(ValuatorMask* mask) {
+  memset(mask, 0, sizeof(StubValuatorMask));
+}
+
+// Timers are never fired on their own; tests run them with stub_timer_run()
+// on whatever clock GetTimeInMicros() reports.
+struct _OsTimerRec {
+  struct _OsTimerRec* next;
+  CARD32 expires;
+  OsTimerCallback callback;
+  pointer arg;
+  Bool armed;
+};
+
+static OsTimerPtr stub_timers;
+
 void TimerCancel(OsTimerPtr  pTimer) {
-  return;
+  if (pTimer)
+    pTimer->armed = FALSE;
 }
 
 void TimerFree(OsTimerPtr  pTimer) {
-  return;
+  OsTimerPtr* p;
+
+  for (p = &stub_timers; *p; p = &(*p)->next) {
+    if (*p == pTimer) {
+      *p = pTimer->next;
+      free(pTimer);
+      return;
+    }
+  }
 }
 
 OsTimerPtr TimerSet(OsTimerPtr timer,
@@ -47,13 +151,71 @@ OsTimerPtr TimerSet(OsTimerPtr timer,
                     CARD32 millis,
                     OsTimerCallback func,
                     pointer arg) {
+  if (!timer) {
+    timer = calloc(1, sizeof(*timer));
+    if (!timer)
+      return NULL;
+    timer->next = stub_timers;
+    stub_timers = timer;
+  }
+  timer->callback = func;
+  timer->arg = arg;
+  timer->armed = func && millis;
+  timer->expires = millis;
+  if (!(flags & TimerAbsolute))
+    timer->expires += GetTimeInMicros() / 1000;
   return timer;
 }
 
+// Earliest armed timer, or NULL.
+OsTimerPtr stub_timer_next(CARD32* expires) {
+  OsTimerPtr timer;
+  OsTimerPtr next = NULL;
+
+  for (timer = stub_timers; timer; timer = timer->next)
+    if (timer->armed && (!next || (int)(timer->expires - next->expires) < 0))
+      next = timer;
+  if (next && expires)
+    *expires = next->expires;
+  return next;
+}
+
+// Fire a timer the way the server does, re-arming it if asked to.
+void stub_timer_run(OsTimerPtr timer, CARD32 now) {
+  CARD32 next;
+
+  timer->armed = FALSE;
+  next = timer->callback(timer, now, timer->arg);
+  if (next)
+    TimerSet(timer, 0, next, timer->callback, timer->arg);
+}
+
+// There is no input thread, everything runs on the caller's thread.
+void input_lock(void) {
+  return;
+}
+
+void input_unlock(void) {
+  return;
+}
+
+int InputThreadRegisterDev(int fd, NotifyFdProcPtr readInputProc,
+                           void* readInputArgs) {
+  return 1;
+}
+
+int InputThreadUnregisterDev(int fd) {
+  return 1;
+}
+
 void xf86AddEnabledDevice(InputInfoPtr pInfo) {
   return;
 }
 
+pointer xf86AddGeneralHandler(int fd, InputHandlerProc proc, pointer data) {
+  return NULL;
+}
+
 void xf86AddInputDriver(InputDriverPtr driver, pointer module, int flags) {
   return;
 }
@@ -83,6 +245,10 @@ int xf86FlushInput(int fd) {
   return 0;
 }
 
+int xf86GetVerbosity(void) {
+  return 0;
+}
+
 void xf86IDrvMsg(LocalDevicePtr dev, MessageType type,
                  const char* format, ...) {
   va_list args;
@@ -123,16 +289,56 @@ void xf86PostButtonEvent(DeviceIntPtr device, int is_absolute, int button,
          is_absolute, button, is_down, first_valuator, num_valuators);
 }
 
+void xf86PostButtonEventM(DeviceIntPtr device, int is_absolute, int button,
+                          int is_down, const ValuatorMask* mask) {
+  if (!stub_event_output)
+    return;
+  fprintf(stub_event_output, "button %d %s", button, is_down ? "down" : "up");
+  stub_print_mask(mask);
+}
+
+void xf86PostKeyboardEvent(DeviceIntPtr device, unsigned int key_code,
+                           int is_down) {
+  if (!stub_event_output)
+    return;
+  fprintf(stub_event_output, "key %u %s\n", key_code, is_down ? "down" : "up");
+}
+
 void xf86PostMotionEvent(DeviceIntPtr device, int is_absolute,
                          int first_valuator, int num_valuators, ...) {
   printf("PostMotionEvent: %d %d %d %d\n",
          is_absolute, first_valuator, num_valuators);
 }
 
+void xf86PostMotionEventM(DeviceIntPtr device, int is_absolute,
+                          const ValuatorMask* mask) {
+  if (!stub_event_output)
+    return;
+  fprintf(stub_event_output, "motion %s", is_absolute ? "abs" : "rel");
+  stub_print_mask(mask);
+}
+
+void xf86PostTouchEvent(DeviceIntPtr dev, uint32_t touchid, uint16_t type,
+                        uint32_t flags, const ValuatorMask* mask) {
+  if (!stub_event_output)
+    return;
+  fprintf(stub_event_output, "touch %u type %u", touchid, type);
+  stub_print_mask(mask);
+}
+
 void xf86ProcessCommonOptions(InputInfoPtr pInfo, pointer options) {
   return;
 }
 
+char* xf86ReplaceStrOption(pointer optlist, const char* name,
+                           const char* val) {
+  return NULL;
+}
+
+int xf86RemoveGeneralHandler(pointer handler) {
+  return 0;
+}
+
 void xf86RemoveEnabledDevice(InputInfoPtr pInfo) {
   return;
 }
@@ -157,11 +363,23 @@ void xf86UnblockSIGIO(int s) {
   return;
 }
 
+void xf86VDrvMsgVerb(int scrnIndex, MessageType type, int verb,
+                     const char* format, va_list args) {
+  vprintf(format, args);
+}
+
 void xf86VIDrvMsgVerb(LocalDevicePtr dev, MessageType type, int verb,
                       const char* format, va_list args) {
   vprintf(format, args);
 }
 
+// The last registered handlers, so tests can drive them like the server.
+int (*stub_property_set)(DeviceIntPtr dev, Atom property,
+                         XIPropertyValuePtr prop, BOOL checkonly) = NULL;
+int (*stub_property_get)(DeviceIntPtr dev, Atom property) = NULL;
+
+// Like the server, run the registered set handler as a check and then for
+// real before accepting the new value.
 int XIChangeDeviceProperty(DeviceIntPtr dev,
                            Atom property,
                            Atom type,
@@ -170,7 +388,19 @@ int XIChangeDeviceProperty(DeviceIntPtr dev,
                            unsigned long len,
                            pointer value,
                            Bool sendevent) {
-  return 0;
+  XIPropertyValueRec val;
+  int rc;
+
+  if (!stub_property_set)
+    return 0;
+  val.type = type;
+  val.format = format;
+  val.size = len;
+  val.data = value;
+  rc = stub_property_set(dev, property, &val, TRUE);
+  if (rc != 0)
+    return rc;
+  return stub_property_set(dev, property, &val, FALSE);
 }
 
 int XIDeleteDeviceProperty(DeviceIntPtr device,
@@ -193,7 +423,9 @@ long XIRegisterPropertyHandler(
                         Atom property),
     int (*DeleteProperty) (DeviceIntPtr dev,
                            Atom property)) {
-  return 0;
+  stub_property_set = SetProperty;
+  stub_property_get = GetProperty;
+  return 1;
 }
 
 int XISetDevicePropertyDeletable(DeviceIntPtr dev,
@@ -205,3 +437,7 @@ int XISetDevicePropertyDeletable(DeviceIntPtr dev,
 void XIUnregisterPropertyHandler(DeviceIntPtr dev, long id) {
   return;
 }
+
+void XkbFreeRMLVOSet(XkbRMLVOSet* rmlvo, Bool freeRMLVO) {
+  return;
+}
@@ -0,0 +1,468 @@
+/*
+ * Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "timer.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cmt.h"
+#include "gesture.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+#define NSEC_PER_MSEC 1000000ULL
+
+typedef struct TimerQueueRec* TimerQueuePtr;
+
+struct GesturesTimer {
+    GesturesTimerCallback callback;
+    void* callback_data;
+    GesturePtr rec;          /* Device the timer belongs to */
+    TimerQueuePtr queue;
+    CARD64 due;              /* CLOCK_MONOTONIC deadline in ns */
+    int heap_index;          /* Index in queue->heap, -1 when not armed */
+    unsigned int generation; /* Bumped on free, tells reuses of the entry */
+    GesturesTimer* next_free;
+    Bool in_use;
+    Bool is_monotonic;
+};
+
+typedef struct TimerQueueRec {
+    GesturesTimer* heap[CMT_TIMER_POOL_SIZE];  /* Min-heap on due */
+    int size;
+    int timers;       /* Timers created on this queue */
+    Bool hires;       /* timerfd backend instead of the server timer list */
+    Bool running;     /* Dispatching, defer arming the backend */
+    OsTimerPtr os_timer;
+    int fd;
+    pointer handler;  /* Fd handler, the queue itself on the input thread */
+} TimerQueueRec;
+
+static TimerQueueRec timer_queue = { .hires = FALSE, .fd = -1 };
+static TimerQueueRec hires_timer_queue = { .hires = TRUE, .fd = -1 };
+
+static GesturesTimer timer_pool[CMT_TIMER_POOL_SIZE];
+static GesturesTimer* timer_free_list;
+static int timer_pool_used;  /* Pool entries handed out at least once */
+
+static GesturesTimer* Timer_Create(void*);
+static GesturesTimer* Timer_HiresCreate(void*);
+static void Timer_Set(void*, GesturesTimer*, stime_t, GesturesTimerCallback,
+                      void*);
+static void Timer_Cancel(void*, GesturesTimer*);
+static void Timer_Free(void*, GesturesTimer*);
+
+static CARD32 Timer_OsTimerCallback(OsTimerPtr, CARD32, pointer);
+static void Timer_FdCallback(int, pointer);
+#ifdef HAVE_THREADED_INPUT
+static void Timer_FdNotify(int, int, void*);
+#endif
+
+GesturesTimerProvider timer_provider = {
+    .create_fn = Timer_Create,
+    .set_fn = Timer_Set,
+    .cancel_fn = Timer_Cancel,
+    .free_fn = Timer_Free
+};
+
+GesturesTimerProvider hires_timer_provider = {
+    .create_fn = Timer_HiresCreate,
+    .set_fn = Timer_Set,
+    .cancel_fn = Timer_Cancel,
+    .free_fn = Timer_Free
+};
+
+stime_t
+Timer_Now(int is_monotonic)
+{
+    if (is_monotonic) {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return StimeFromTimespec(&ts);
+    } else {
+      struct timeval tv;
+      gettimeofday(&tv, NULL);
+      return StimeFromTimeval(&tv);
+    }
+}
+
+static CARD64
+Timer_MonotonicNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Min-heap of armed timers, ordered by due time
+ */
+static void
+Timer_HeapPlace(TimerQueuePtr queue, GesturesTimer* tm, int i)
+{
+    queue->heap[i] = tm;
+    tm->heap_index = i;
+}
+
+static void
+Timer_HeapUp(TimerQueuePtr queue, int i)
+{
+    GesturesTimer* tm = queue->heap[i];
+    int parent;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (queue->heap[parent]->due <= tm->due)
+            break;
+        Timer_HeapPlace(queue, queue->heap[parent], i);
+        i = parent;
+    }
+    Timer_HeapPlace(queue, tm, i);
+}
+
+static void
+Timer_HeapDown(TimerQueuePtr queue, int i)
+{
+    GesturesTimer* tm = queue->heap[i];
+    int child;
+
+    for (;;) {
+        child = 2 * i + 1;
+        if (child >= queue->size)
+            break;
+        if (child + 1 < queue->size &&
+            queue->heap[child + 1]->due < queue->heap[child]->due)
+            child++;
+        if (tm->due <= queue->heap[child]->due)
+            break;
+        Timer_HeapPlace(queue, queue->heap[child], i);
+        i = child;
+    }
+    Timer_HeapPlace(queue, tm, i);
+}
+
+static void
+Timer_HeapInsert(TimerQueuePtr queue, GesturesTimer* tm)
+{
+    Timer_HeapPlace(queue, tm, queue->size++);
+    Timer_HeapUp(queue, tm->heap_index);
+}
+
+static void
+Timer_HeapRemove(TimerQueuePtr queue, GesturesTimer* tm)
+{
+    int i = tm->heap_index;
+    GesturesTimer* last;
+
+    if (i < 0)
+        return;
+    tm->heap_index = -1;
+    last = queue->heap[--queue->size];
+    if (last == tm)
+        return;
+    Timer_HeapPlace(queue, last, i);
+    Timer_HeapUp(queue, i);
+    Timer_HeapDown(queue, last->heap_index);
+}
+
+/**
+ * Backend management
+ */
+static Bool
+Timer_QueueOpen(TimerQueuePtr queue, InputInfoPtr info)
+{
+    if (!queue->hires) {
+        if (!queue->os_timer)
+            queue->os_timer = TimerSet(NULL, 0, 0, NULL, 0);
+        return queue->os_timer != NULL;
+    }
+
+    if (queue->fd >= 0)
+        return TRUE;
+    queue->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (queue->fd < 0) {
+        ERR(info, "timerfd_create failed: %s\n", strerror(errno));
+        return FALSE;
+    }
+#ifdef HAVE_THREADED_INPUT
+    /* Fire on the input thread, serialized with ReadInput */
+    if (InputThreadRegisterDev(queue->fd, Timer_FdNotify, queue))
+        queue->handler = queue;
+#else
+    queue->handler = xf86AddGeneralHandler(queue->fd, Timer_FdCallback, queue);
+#endif
+    if (!queue->handler) {
+        close(queue->fd);
+        queue->fd = -1;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+Timer_QueueClose(TimerQueuePtr queue)
+{
+    if (queue->os_timer) {
+        TimerFree(queue->os_timer);
+        queue->os_timer = NULL;
+    }
+    if (queue->fd >= 0) {
+#ifdef HAVE_THREADED_INPUT
+        InputThreadUnregisterDev(queue->fd);
+#else
+        xf86RemoveGeneralHandler(queue->handler);
+#endif
+        queue->handler = NULL;
+        close(queue->fd);
+        queue->fd = -1;
+    }
+}
+
+/*
+ * Milliseconds until the earliest timer is due, rounded up so the server
+ * timer never fires before it. 0 when no timer is armed.
+ */
+static CARD32
+Timer_QueueNextMs(TimerQueuePtr queue)
+{
+    CARD64 now;
+    CARD64 due;
+
+    if (!queue->size)
+        return 0;
+    now = Timer_MonotonicNs();
+    due = queue->heap[0]->due;
+    if (due <= now)
+        return 1;
+    return (due - now + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC;
+}
+
+/*
+ * Point the backend at the earliest armed timer, or disarm it.
+ */
+static void
+Timer_QueueArm(TimerQueuePtr queue)
+{
+    struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+    CARD32 ms;
+
+    /* Nothing to arm while dispatching, or once the backend is closed. */
+    if (queue->running || !queue->timers)
+        return;
+
+    if (!queue->hires) {
+        ms = Timer_QueueNextMs(queue);
+        if (ms)
+            TimerSet(queue->os_timer, 0, ms, Timer_OsTimerCallback, queue);
+        else
+            TimerCancel(queue->os_timer);
+        return;
+    }
+
+    if (queue->size) {
+        its.it_value.tv_sec = queue->heap[0]->due / NSEC_PER_SEC;
+        its.it_value.tv_nsec = queue->heap[0]->due % NSEC_PER_SEC;
+    }
+    timerfd_settime(queue->fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/*
+ * Record how late a timer fired relative to the deadline it was set for.
+ */
+static void
+Timer_Lateness(GesturesTimer* tm, CARD64 now)
+{
+    GesturePtr rec = tm->rec;
+    int late_us = (now - tm->due) / 1000;
+
+    rec->timer_late_total_us += late_us;
+    rec->timer_stats[CMT_TIMER_STAT_FIRES]++;
+    rec->timer_stats[CMT_TIMER_STAT_LATE_MEAN_US] =
+        rec->timer_late_total_us / rec->timer_stats[CMT_TIMER_STAT_FIRES];
+    if (late_us > rec->timer_stats[CMT_TIMER_STAT_LATE_MAX_US])
+        rec->timer_stats[CMT_TIMER_STAT_LATE_MAX_US] = late_us;
+}
+
+/*
+ * Run every timer that is due. A callback returning a non-negative delay
+ * re-arms its timer, like the return value of an OsTimerCallback. A timer
+ * freed by its callback is not re-armed, even if a new timer has taken
+ * over its pool entry in the meantime.
+ */
+static void
+Timer_QueueRun(TimerQueuePtr queue)
+{
+    CARD64 now = Timer_MonotonicNs();
+    GesturesTimer* tm;
+    unsigned int generation;
+    stime_t rc;
+
+    queue->running = TRUE;
+    while (queue->size && queue->heap[0]->due <= now) {
+        tm = queue->heap[0];
+        Timer_HeapRemove(queue, tm);
+        Timer_Lateness(tm, now);
+
+        generation = tm->generation;
+        rc = tm->callback(Timer_Now(tm->is_monotonic), tm->callback_data);
+        Gesture_Flush_Coalesced(tm->rec);
+        if (rc >= 0.0 && tm->in_use && tm->generation == generation) {
+            Timer_HeapRemove(queue, tm);
+            tm->due = Timer_MonotonicNs() + (CARD64)(rc * NSEC_PER_SEC);
+            Timer_HeapInsert(queue, tm);
+        }
+    }
+    queue->running = FALSE;
+
+    /*
+     * Close the backend if a callback freed the last timer. The server
+     * timer does not touch its OsTimer after a callback that returns 0,
+     * which is what Timer_OsTimerCallback returns with no timer left.
+     */
+    if (!queue->timers)
+        Timer_QueueClose(queue);
+}
+
+static CARD32
+Timer_OsTimerCallback(OsTimerPtr timer, CARD32 millis, pointer data)
+{
+    TimerQueuePtr queue = data;
+
+    Timer_QueueRun(queue);
+    return Timer_QueueNextMs(queue);
+}
+
+static void
+Timer_FdCallback(int fd, pointer data)
+{
+    TimerQueuePtr queue = data;
+    uint64_t expirations;
+
+    /* Nothing to read if the timer was re-armed since it expired. */
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return;
+
+    Timer_QueueRun(queue);
+    Timer_QueueArm(queue);
+}
+
+#ifdef HAVE_THREADED_INPUT
+static void
+Timer_FdNotify(int fd, int ready, void* data)
+{
+    input_lock();
+    Timer_FdCallback(fd, data);
+    input_unlock();
+}
+#endif
+
+/**
+ * GesturesTimerProvider implementation
+ */
+static GesturesTimer*
+Timer_CreateOn(void* provider_data, TimerQueuePtr queue)
+{
+    DeviceIntPtr dev = provider_data;
+    InputInfoPtr info = dev->public.devicePrivate;
+    CmtDevicePtr cmt = info->private;
+    GesturesTimer* timer;
+
+    if (timer_free_list) {
+        timer = timer_free_list;
+        timer_free_list = timer->next_free;
+    } else if (timer_pool_used < CMT_TIMER_POOL_SIZE) {
+        timer = &timer_pool[timer_pool_used++];
+    } else {
+        ERR(info, "Out of gestures timers\n");
+        return NULL;
+    }
+
+    if (!Timer_QueueOpen(queue, info)) {
+        timer->next_free = timer_free_list;
+        timer_free_list = timer;
+        return NULL;
+    }
+    queue->timers++;
+
+    timer->callback = NULL;
+    timer->callback_data = NULL;
+    timer->rec = &cmt->gesture;
+    timer->queue = queue;
+    timer->heap_index = -1;
+    timer->next_free = NULL;
+    timer->in_use = TRUE;
+    timer->is_monotonic = cmt->evdev.info.is_monotonic;
+    return timer;
+}
+
+static GesturesTimer*
+Timer_Create(void* provider_data)
+{
+    return Timer_CreateOn(provider_data, &timer_queue);
+}
+
+static GesturesTimer*
+Timer_HiresCreate(void* provider_data)
+{
+    return Timer_CreateOn(provider_data, &hires_timer_queue);
+}
+
+static void
+Timer_Set(void* provider_data,
+          GesturesTimer* timer,
+          stime_t delay,
+          GesturesTimerCallback callback,
+          void* callback_data)
+{
+    TimerQueuePtr queue;
+
+    if (!timer)
+        return;
+    queue = timer->queue;
+    timer->callback = callback;
+    timer->callback_data = callback_data;
+    if (delay < 0.0)
+        delay = 0.0;
+
+    Timer_HeapRemove(queue, timer);
+    timer->due = Timer_MonotonicNs() + (CARD64)(delay * NSEC_PER_SEC);
+    Timer_HeapInsert(queue, timer);
+    Timer_QueueArm(queue);
+}
+
+static void
+Timer_Cancel(void* provider_data, GesturesTimer* timer)
+{
+    TimerQueuePtr queue;
+
+    if (!timer || timer->heap_index < 0)
+        return;
+    queue = timer->queue;
+    Timer_HeapRemove(queue, timer);
+    Timer_QueueArm(queue);
+}
+
+static void
+Timer_Free(void* provider_data, GesturesTimer* timer)
+{
+    TimerQueuePtr queue;
+
+    if (!timer)
+        return;
+    queue = timer->queue;
+    Timer_Cancel(provider_data, timer);
+    timer->in_use = FALSE;
+    timer->generation++;
+    timer->next_free = timer_free_list;
+    timer_free_list = timer;
+
+    /* While dispatching, Timer_QueueRun closes the backend once done. */
+    if (--queue->timers == 0 && !queue->running)
+        Timer_QueueClose(queue);
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include <gestures/gestures.h>
+
+#include <xorg-server.h>
+#include <xf86.h>
+
+/*
+ * Driver-wide scheduler for gestures timers. The timers of all cmt devices
+ * share one min-heap per backend, which is multiplexed onto a single OS
+ * timer: either an entry in the server timer list (millisecond resolution)
+ * or a timerfd (nanosecond resolution). Timers come from a preallocated
+ * pool, so creating and freeing them never allocates.
+ *
+ * With an input thread, the timerfd is polled by that thread, so hires
+ * timers fire on the same thread as ReadInput. The server timer list runs
+ * on the main thread with the input lock held.
+ */
+
+/* Creating a timer fails once this many are in use across all devices. */
+#define CMT_TIMER_POOL_SIZE 256
+
+/* Timers backed by the server timer list */
+extern GesturesTimerProvider timer_provider;
+
+/* Timers backed by a timerfd */
+extern GesturesTimerProvider hires_timer_provider;
+
+/*
+ * Current time in the clock a device timestamps its events with.
+ */
+stime_t Timer_Now(int is_monotonic);
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2011 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "bench.h"
+
+#include "timer.h"
+
+typedef struct {
+    BenchDevicePtr bd;
+    GesturesTimerProvider* provider;
+} TimerBenchRec, *TimerBenchPtr;
+
+static stime_t
+Bench_Timer_Callback(stime_t now, void* data)
+{
+    return -1.0;
+}
+
+static void
+Bench_Timer_CreateFree(void* data, unsigned long iterations)
+{
+    TimerBenchPtr tb = data;
+    void* dev = &tb->bd->dev;
+    GesturesTimer* timer;
+    unsigned long i;
+
+    for (i = 0; i < iterations; i++) {
+        timer = tb->provider->create_fn(dev);
+        tb->provider->free_fn(dev, timer);
+    }
+}
+
+/* Arm and disarm a timer, as the interpreter does on most frames. */
+static void
+Bench_Timer_SetCancel(void* data, unsigned long iterations)
+{
+    TimerBenchPtr tb = data;
+    void* dev = &tb->bd->dev;
+    GesturesTimer* timer = tb->provider->create_fn(dev);
+    unsigned long i;
+
+    for (i = 0; i < iterations; i++) {
+        tb->provider->set_fn(dev, timer, 1.0, Bench_Timer_Callback, NULL);
+        tb->provider->cancel_fn(dev, timer);
+    }
+    tb->provider->free_fn(dev, timer);
+}
+
+void
+Timer_Bench(void)
+{
+    TimerBenchRec tb;
+
+    tb.bd = Bench_Device_New(EvdevClassTouchpad, 2);
+
+    tb.provider = &timer_provider;
+    Bench_Run("Timer/create_free", Bench_Timer_CreateFree, &tb);
+    Bench_Run("Timer/set_cancel", Bench_Timer_SetCancel, &tb);
+
+    tb.provider = &hires_timer_provider;
+    Bench_Run("Timer/hires/create_free", Bench_Timer_CreateFree, &tb);
+    Bench_Run("Timer/hires/set_cancel", Bench_Timer_SetCancel, &tb);
+
+    Bench_Device_Free(tb.bd);
+}